@@ -2,7 +2,7 @@ import pandas as pd
 import numpy as np
 import matplotlib.pyplot as plt
     
-signal = pd.read_csv('output.csv')
+signal = pd.read_csv('output.csv', comment='#')   # '#' lines mark link gaps
 
 for channel in signal.columns[5:]:
     print(signal[channel])
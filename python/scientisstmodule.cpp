@@ -0,0 +1,472 @@
+// Python bindings of ScientISST, built with "make python".
+//
+// read() returns a Block whose seq, digital, raw and mv attributes are memoryviews of the library's own
+// buffers, so numpy.asarray() wraps them without copying. The buffers are overwritten by the next read(),
+// copy them (numpy.array()) to keep the data. start() refuses to run while views of the previous
+// acquisition are alive, since it may reallocate them. The GIL is released while the device is contacted
+// and while frames are received and decoded, so other Python threads keep running.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "scientisst.h"
+#include "bulk.h"
+
+static PyObject *ScientISSTError;      //scientisst.Error, with args (code, description)
+
+enum Column { COLUMN_SEQ, COLUMN_DIGITAL, COLUMN_RAW, COLUMN_MV };
+
+typedef struct {
+    PyObject_HEAD
+    ScientISST *dev;
+    bool busy;                  //A call runs without the GIL, the device cannot take another one
+    Py_ssize_t exports;         //Buffers of dev->block exported and not released yet
+} DeviceObject;
+
+typedef struct {
+    PyObject_HEAD
+    Block *block;
+    PyObject *owner;            //Device the block belongs to, NULL if the block is owned
+    Py_ssize_t own_exports;
+    Py_ssize_t *exports;        //Exports counter of the block, the device's one or own_exports
+} BlockObject;
+
+typedef struct {
+    PyObject_HEAD
+    BlockObject *block;
+    char format[2];
+    int ndim;
+    Py_ssize_t itemsize;
+    Py_ssize_t shape[2];        //Frames of the block when the view was taken
+    Py_ssize_t strides[2];
+    void *buf;
+} ArrayObject;
+
+static PyTypeObject DeviceType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject BlockType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject ArrayType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+/*****************************************************************************/
+
+static PyObject* raiseError(int code, const char *description){
+    PyObject *args = Py_BuildValue("(is)", code, description);
+
+    if(args != NULL){
+        PyErr_SetObject(ScientISSTError, args);
+        Py_DECREF(args);
+    }
+    return NULL;
+}
+
+// Runs call without the GIL, returns the code of the library exception it threw or 0.
+template<typename Call> static int withoutGil(Call call){
+    int code = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    try{
+        call();
+    }catch(ScientISST::Exception &e){
+        code = e.code;
+    }catch(ScientISST::Exception::Code c){
+        code = c;
+    }
+    Py_END_ALLOW_THREADS
+
+    return code;
+}
+
+// Raises scientisst.Error for the code of a library exception.
+static void raiseCode(int code){
+    ScientISST::Exception e((ScientISST::Exception::Code)code);
+    raiseError(code, e.getDescription());
+}
+
+// Runs call on the device without the GIL, translating the library exceptions to scientisst.Error.
+// Returns false with the Python error set if it failed.
+template<typename Call> static bool callDevice(DeviceObject *self, Call call){
+    if(self->dev == NULL){
+        PyErr_SetString(PyExc_ValueError, "device is not open");
+        return false;
+    }
+    if(self->busy){
+        PyErr_SetString(PyExc_RuntimeError, "device is busy in another thread");
+        return false;
+    }
+
+    ScientISST &dev = *self->dev;
+    self->busy = true;
+    const int code = withoutGil([&](){ call(dev); });
+    self->busy = false;
+
+    if(code == 0)   return true;
+    raiseCode(code);
+    return false;
+}
+
+/*****************************************************************************/
+
+// Arrays
+
+static int Array_getbuffer(ArrayObject *self, Py_buffer *view, int flags){
+    if(flags & PyBUF_WRITABLE){
+        PyErr_SetString(PyExc_BufferError, "acquired data is read-only");
+        return -1;
+    }
+    if(self->ndim == 2 && !(flags & PyBUF_STRIDES)){
+        PyErr_SetString(PyExc_BufferError, "channel arrays need strides");
+        return -1;
+    }
+
+    view->obj = (PyObject*)self;
+    Py_INCREF(self);
+    view->buf = self->buf;
+    view->len = self->itemsize * self->shape[0] * (self->ndim == 2 ? self->shape[1] : 1);
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+    view->ndim = self->ndim;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+
+    (*self->block->exports)++;
+    return 0;
+}
+
+static void Array_releasebuffer(ArrayObject *self, Py_buffer *view){
+    (*self->block->exports)--;
+}
+
+static void Array_dealloc(ArrayObject *self){
+    Py_XDECREF(self->block);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyBufferProcs Array_as_buffer = { (getbufferproc)Array_getbuffer, (releasebufferproc)Array_releasebuffer };
+
+// A memoryview of a column of the block, as it is now.
+static PyObject* newArray(BlockObject *block, Column column){
+    ArrayObject *a = PyObject_New(ArrayObject, &ArrayType);
+    if(a == NULL)   return NULL;
+
+    Block &b = *block->block;
+    Py_INCREF(block);
+    a->block = block;
+    a->format[1] = '\0';
+    if(column == COLUMN_SEQ || column == COLUMN_DIGITAL){
+        a->buf = (column == COLUMN_SEQ) ? b.seq.data() : b.digital.data();
+        a->format[0] = 'B';
+        a->itemsize = 1;
+        a->ndim = 1;
+        a->shape[0] = b.num_frames;
+        a->strides[0] = 1;
+    }else{
+        //One row per channel, the rows are capacity frames apart
+        a->buf = (column == COLUMN_RAW) ? b.raw.data() : b.mv.data();
+        a->format[0] = 'i';
+        a->itemsize = sizeof(int32_t);
+        a->ndim = 2;
+        a->shape[0] = b.num_chs;
+        a->shape[1] = b.num_frames;
+        a->strides[0] = b.capacity*sizeof(int32_t);
+        a->strides[1] = sizeof(int32_t);
+    }
+
+    PyObject *view = PyMemoryView_FromObject((PyObject*)a);
+    Py_DECREF(a);
+    return view;
+}
+
+/*****************************************************************************/
+
+// Blocks
+
+static BlockObject* newBlock(Block *block, PyObject *owner){
+    BlockObject *self = PyObject_New(BlockObject, &BlockType);
+    if(self == NULL)   return NULL;
+
+    self->block = block;
+    self->owner = owner;
+    self->own_exports = 0;
+    if(owner != NULL){
+        Py_INCREF(owner);
+        self->exports = &((DeviceObject*)owner)->exports;
+    }else{
+        self->exports = &self->own_exports;
+    }
+    return self;
+}
+
+static void Block_dealloc(BlockObject *self){
+    if(self->owner != NULL)
+        Py_DECREF(self->owner);
+    else
+        delete self->block;
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* Block_num_frames(BlockObject *self, void*){ return PyLong_FromLong(self->block->num_frames); }
+static PyObject* Block_sample_rate(BlockObject *self, void*){ return PyFloat_FromDouble(self->block->sample_rate); }
+static PyObject* Block_seq(BlockObject *self, void*){ return newArray(self, COLUMN_SEQ); }
+static PyObject* Block_digital(BlockObject *self, void*){ return newArray(self, COLUMN_DIGITAL); }
+static PyObject* Block_raw(BlockObject *self, void*){ return newArray(self, COLUMN_RAW); }
+static PyObject* Block_mv(BlockObject *self, void*){ return newArray(self, COLUMN_MV); }
+
+static PyObject* Block_channels(BlockObject *self, void*){
+    PyObject *chs = PyTuple_New(self->block->num_chs);
+    if(chs == NULL)   return NULL;
+
+    for(int i = 0; i < self->block->num_chs; i++)
+        PyTuple_SET_ITEM(chs, i, PyLong_FromLong(self->block->chs[i]));
+    return chs;
+}
+
+static PyGetSetDef Block_getset[] = {
+    {(char*)"num_frames", (getter)Block_num_frames, NULL, (char*)"Number of frames of the block", NULL},
+    {(char*)"sample_rate", (getter)Block_sample_rate, NULL, (char*)"Rate of the frames, lower than the acquisition rate when decimating", NULL},
+    {(char*)"channels", (getter)Block_channels, NULL, (char*)"Channel of each row of raw and mv (AI1...AX2)", NULL},
+    {(char*)"seq", (getter)Block_seq, NULL, (char*)"Sequence numbers, uint8 memoryview of num_frames", NULL},
+    {(char*)"digital", (getter)Block_digital, NULL, (char*)"Digital ports I1 I2 O1 O2 as bits 3...0, uint8 memoryview of num_frames", NULL},
+    {(char*)"raw", (getter)Block_raw, NULL, (char*)"Raw values, int32 memoryview of channels x num_frames", NULL},
+    {(char*)"mv", (getter)Block_mv, NULL, (char*)"Values in mV (AI) or sign extended (AX), int32 memoryview of channels x num_frames", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+/*****************************************************************************/
+
+// Devices
+
+static int Device_init(DeviceObject *self, PyObject *args, PyObject *kwds){
+    static const char *kwlist[] = {"address", NULL};
+    const char *address;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "s", (char**)kwlist, &address))   return -1;
+    if(self->dev != NULL){
+        PyErr_SetString(PyExc_RuntimeError, "device is already open");
+        return -1;
+    }
+
+    //The constructor connects to the device, it runs without the GIL like the other calls
+    ScientISST *dev = NULL;
+    const int code = withoutGil([&](){ dev = new ScientISST(address); });
+    if(code != 0){
+        raiseCode(code);
+        return -1;
+    }
+    self->dev = dev;
+    return 0;
+}
+
+static void Device_dealloc(DeviceObject *self){
+    if(self->dev != NULL){
+        Py_BEGIN_ALLOW_THREADS
+        delete self->dev;       //Stops an acquisition in progress
+        Py_END_ALLOW_THREADS
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* Device_start(DeviceObject *self, PyObject *args, PyObject *kwds){
+    static const char *kwlist[] = {"sample_rate", "channels", "file", "simulated", "api", NULL};
+    int sample_rate;
+    PyObject *channels = NULL;
+    const char *file = NULL;
+    int simulated = 0;
+    int api = API_MODE_SCIENTISST;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|Ozpi", (char**)kwlist, &sample_rate, &channels, &file, &simulated, &api))
+        return NULL;
+    if(self->exports > 0){
+        PyErr_SetString(PyExc_BufferError, "views of the previous acquisition are still in use");
+        return NULL;
+    }
+
+    ScientISST::Vint chs;
+    if(channels != NULL && channels != Py_None){
+        PyObject *seq = PySequence_Fast(channels, "channels must be a sequence");
+        if(seq == NULL)   return NULL;
+        for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++){
+            const long ch = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if(ch == -1 && PyErr_Occurred()){
+                Py_DECREF(seq);
+                return NULL;
+            }
+            chs.push_back(ch);
+        }
+        Py_DECREF(seq);
+    }
+
+    if(!callDevice(self, [&](ScientISST &d){ d.start(sample_rate, chs, file, simulated != 0, api); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject* Device_stop(DeviceObject *self, PyObject*){
+    if(!callDevice(self, [](ScientISST &d){ d.stop(); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject* Device_read(DeviceObject *self, PyObject*){
+    if(!callDevice(self, [](ScientISST &d){ d.read(); }))   return NULL;
+    return (PyObject*)newBlock(&self->dev->block, (PyObject*)self);
+}
+
+static PyObject* Device_version(DeviceObject *self, PyObject*){
+    if(!callDevice(self, [](ScientISST &d){ d.versionAndAdcChars(); }))   return NULL;
+    return PyUnicode_FromString(self->dev->firmware_version.c_str());
+}
+
+static PyObject* Device_battery(DeviceObject *self, PyObject *args){
+    int value = 0;
+
+    if(!PyArg_ParseTuple(args, "|i", &value))   return NULL;
+    if(!callDevice(self, [=](ScientISST &d){ d.battery(value); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject* Device_trigger(DeviceObject *self, PyObject *args){
+    PyObject *outputs = NULL;
+    ScientISST::Vbool digital;
+
+    if(!PyArg_ParseTuple(args, "|O", &outputs))   return NULL;
+    if(outputs != NULL){
+        PyObject *seq = PySequence_Fast(outputs, "outputs must be a sequence");
+        if(seq == NULL)   return NULL;
+        for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++)
+            digital.push_back(PyObject_IsTrue(PySequence_Fast_GET_ITEM(seq, i)) == 1);
+        Py_DECREF(seq);
+    }
+
+    if(!callDevice(self, [&](ScientISST &d){ d.trigger(digital); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject* Device_dac(DeviceObject *self, PyObject *args){
+    int value = 100;
+
+    if(!PyArg_ParseTuple(args, "|i", &value))   return NULL;
+    if(!callDevice(self, [=](ScientISST &d){ d.dac(value); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject* Device_block_duration(DeviceObject *self, PyObject *args){
+    int ms = 0;
+
+    if(!PyArg_ParseTuple(args, "|i", &ms))   return NULL;
+    if(!callDevice(self, [=](ScientISST &d){ d.blockDuration(ms); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject* Device_capture(DeviceObject *self, PyObject *args){
+    const char *file = NULL;
+
+    if(!PyArg_ParseTuple(args, "z", &file))   return NULL;
+    if(!callDevice(self, [=](ScientISST &d){ d.capture(file); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject* Device_supervise(DeviceObject *self, PyObject *args){
+    int enable = 1;
+
+    if(!PyArg_ParseTuple(args, "|p", &enable))   return NULL;
+    if(!callDevice(self, [=](ScientISST &d){ d.supervise(enable != 0); }))   return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef Device_methods[] = {
+    {"start", (PyCFunction)(void(*)(void))Device_start, METH_VARARGS | METH_KEYWORDS,
+     "start(sample_rate, channels=None, file=None, simulated=False, api=API_MODE_SCIENTISST)\n"
+     "Starts an acquisition, of all channels if channels is None."},
+    {"stop", (PyCFunction)Device_stop, METH_NOARGS, "Stops the acquisition."},
+    {"read", (PyCFunction)Device_read, METH_NOARGS,
+     "Reads the next block of frames. The views of the returned Block are overwritten by the next read()."},
+    {"version", (PyCFunction)Device_version, METH_NOARGS, "Returns the firmware version of the device."},
+    {"battery", (PyCFunction)Device_battery, METH_VARARGS, "battery(value=0)\nSets the battery voltage threshold of the low-battery LED."},
+    {"trigger", (PyCFunction)Device_trigger, METH_VARARGS, "trigger(outputs=[])\nSets the digital outputs."},
+    {"dac", (PyCFunction)Device_dac, METH_VARARGS, "dac(value=100)\nSets the analog output (ScientISST 2 only)."},
+    {"block_duration", (PyCFunction)Device_block_duration, METH_VARARGS, "block_duration(ms=0)\nSets the time span of the blocks of the next acquisitions."},
+    {"capture", (PyCFunction)Device_capture, METH_VARARGS, "capture(file)\nRecords the raw bytes of the next acquisitions, None to stop capturing."},
+    {"supervise", (PyCFunction)Device_supervise, METH_VARARGS, "supervise(enable=True)\nReconnects and resumes the acquisition when the link is lost."},
+    {NULL, NULL, 0, NULL}
+};
+
+/*****************************************************************************/
+
+// Module
+
+static PyObject* decode_capture(PyObject*, PyObject *args, PyObject *kwds){
+    static const char *kwlist[] = {"file", "threads", NULL};
+    const char *file;
+    int threads = 0;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|i", (char**)kwlist, &file, &threads))   return NULL;
+
+    Block *block = new Block();
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = BulkDecoder::decodeCapture(file, *block, threads);
+    Py_END_ALLOW_THREADS
+
+    if(!ok){
+        delete block;
+        PyErr_Format(PyExc_ValueError, "%s cannot be decoded", file);
+        return NULL;
+    }
+    return (PyObject*)newBlock(block, NULL);
+}
+
+static PyMethodDef module_methods[] = {
+    {"decode_capture", (PyCFunction)(void(*)(void))decode_capture, METH_VARARGS | METH_KEYWORDS,
+     "decode_capture(file, threads=0)\nDecodes a whole capture on all cores into a Block."},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "scientisst", "ScientISST sense acquisition", -1, module_methods, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_scientisst(void){
+    DeviceType.tp_name = "scientisst.ScientISST";
+    DeviceType.tp_doc = "ScientISST(address)\nConnects to a device, see ScientISST::ScientISST() for the addresses.";
+    DeviceType.tp_basicsize = sizeof(DeviceObject);
+    DeviceType.tp_flags = Py_TPFLAGS_DEFAULT;
+    DeviceType.tp_new = PyType_GenericNew;
+    DeviceType.tp_init = (initproc)Device_init;
+    DeviceType.tp_dealloc = (destructor)Device_dealloc;
+    DeviceType.tp_methods = Device_methods;
+
+    BlockType.tp_name = "scientisst.Block";
+    BlockType.tp_doc = "Frames of a read() or of a decoded capture, in channel arrays.";
+    BlockType.tp_basicsize = sizeof(BlockObject);
+    BlockType.tp_flags = Py_TPFLAGS_DEFAULT;
+    BlockType.tp_dealloc = (destructor)Block_dealloc;
+    BlockType.tp_getset = Block_getset;
+
+    ArrayType.tp_name = "scientisst._Array";
+    ArrayType.tp_basicsize = sizeof(ArrayObject);
+    ArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ArrayType.tp_dealloc = (destructor)Array_dealloc;
+    ArrayType.tp_as_buffer = &Array_as_buffer;
+
+    if(PyType_Ready(&DeviceType) < 0 || PyType_Ready(&BlockType) < 0 || PyType_Ready(&ArrayType) < 0)
+        return NULL;
+
+    PyObject *m = PyModule_Create(&module);
+    if(m == NULL)   return NULL;
+
+    ScientISSTError = PyErr_NewException("scientisst.Error", NULL, NULL);
+    Py_INCREF(ScientISSTError);
+    PyModule_AddObject(m, "Error", ScientISSTError);
+    Py_INCREF(&DeviceType);
+    PyModule_AddObject(m, "ScientISST", (PyObject*)&DeviceType);
+    Py_INCREF(&BlockType);
+    PyModule_AddObject(m, "Block", (PyObject*)&BlockType);
+
+    const struct { const char *name; int value; } constants[] = {
+        {"AI1", AI1}, {"AI2", AI2}, {"AI3", AI3}, {"AI4", AI4}, {"AI5", AI5}, {"AI6", AI6}, {"AX1", AX1}, {"AX2", AX2},
+        {"API_MODE_SCIENTISST", API_MODE_SCIENTISST}, {"API_MODE_JSON", API_MODE_JSON},
+    };
+    for(size_t i = 0; i < sizeof(constants)/sizeof(constants[0]); i++)
+        PyModule_AddIntConstant(m, constants[i].name, constants[i].value);
+
+    return m;
+}
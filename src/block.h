@@ -0,0 +1,55 @@
+#ifndef _BLOCK_H
+#define _BLOCK_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// The frames of one ScientISST::read() in structure of arrays layout: one contiguous array per acquired channel,
+// ordered as the channels given to start(), so filters and writers can work on a whole channel at a time.
+class Block
+{
+public:
+    Block(void) : num_frames(0), num_chs(0), capacity(0), sample_rate(0) {}
+
+    /// Sizes the arrays for up to _capacity frames of _num_chs channels, discarding the current contents.
+    void resize(int _num_chs, int _capacity){
+        num_chs = _num_chs;
+        capacity = _capacity;
+        num_frames = 0;
+        seq.assign(capacity, 0);
+        digital.assign(capacity, 0);
+        raw.assign(num_chs*capacity, 0);
+        mv.assign(num_chs*capacity, 0);
+    }
+
+    /// Copies count frames of src, from its frame first on, to frame at. src has the same channels, and may be this block.
+    void copy(int at, const Block &src, int first, int count){
+        if(count <= 0)   return;
+
+        memmove(&seq[at], &src.seq[first], count);
+        memmove(&digital[at], &src.digital[first], count);
+        for(int i = 0; i < num_chs; i++){
+            memmove(rawCh(i)+at, src.rawCh(i)+first, count*sizeof(int32_t));
+            memmove(mvCh(i)+at, src.mvCh(i)+first, count*sizeof(int32_t));
+        }
+    }
+
+    int32_t* rawCh(int c) { return &raw[c*capacity]; }                  ///< Raw values of the c-th channel
+    const int32_t* rawCh(int c) const { return &raw[c*capacity]; }
+    int32_t* mvCh(int c) { return &mv[c*capacity]; }                    ///< Converted values of the c-th channel
+    const int32_t* mvCh(int c) const { return &mv[c*capacity]; }
+
+    int num_frames;             ///< Number of valid frames
+    int num_chs;                ///< Number of channels
+    int capacity;               ///< Frames each channel array can hold
+    double sample_rate;         ///< Rate of the frames in the block, lower than the acquisition rate when decimating
+    int chs[8];                 ///< Channel of each array (AI1...AX2)
+
+    std::vector<uint8_t> seq;       ///< Frame sequence numbers (0...15)
+    std::vector<uint8_t> digital;   ///< Digital ports I1 I2 O1 O2 as bits 3...0
+    std::vector<int32_t> raw;       ///< Raw ADC values, channel after channel
+    std::vector<int32_t> mv;        ///< Values in mV for AI channels, sign extended values for AX channels, channel after channel
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <thread>
+#include "bulk.h"
+#include "packet.h"
+#include "replay.h"
+#include "scientisst.h"
+
+BulkDecoder::BulkDecoder(const std::vector<int> &channels, const esp_adc_cal_characteristics_t &_adc_chars, int _threads)
+    : skipped_bytes(0), resyncs(0), num_chs(0), adc_chars(_adc_chars), threads(_threads){
+    char chMask = 0;
+
+    if(channels.empty()){
+        for(num_chs = 0; num_chs < 8; num_chs++)
+            chs[num_chs] = num_chs+1;
+    }else{
+        for(size_t i = 0; i < channels.size(); i++){
+            const int ch = channels[i];
+            if (ch <= 0 || ch > 8)   throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+            const char mask = 1 << (ch-1);
+            if (chMask & mask)   throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+            chMask |= mask;
+            chs[num_chs++] = ch;
+        }
+    }
+    packet_size = packetSize(chs, num_chs);
+
+    initAdcLut(&adc_chars);
+    if(threads <= 0)   threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+/*****************************************************************************/
+
+// True if BULK_SYNC_PACKETS valid packets follow each other from at on.
+bool BulkDecoder::synced(const uint8_t *data, size_t len, size_t at) const{
+    if(at + BULK_SYNC_PACKETS*packet_size > len)   return false;
+
+    for(int i = 0; i < BULK_SYNC_PACKETS; i++){
+        if(!checkCRC4(data + at + i*packet_size, packet_size))   return false;
+    }
+    return true;
+}
+
+/*****************************************************************************/
+
+// First offset from from on where BULK_SYNC_PACKETS valid packets follow each other, or len if there is none.
+size_t BulkDecoder::syncPoint(const uint8_t *data, size_t len, size_t from) const{
+    for(size_t at = from; at + BULK_SYNC_PACKETS*packet_size <= len; at++){
+        if(synced(data, len, at))   return at;
+    }
+    return len;
+}
+
+/*****************************************************************************/
+
+// Decodes from t.begin up to the first packet boundary at or past t.end, reading beyond t.end for the packet across it.
+void BulkDecoder::decodeTask(const uint8_t *data, size_t len, Task &t, Block &out) const{
+    const uint8_t *p = data + t.begin;
+    const uint8_t *end = data + t.end;
+    const uint8_t *last = data + len;
+    bool resyncing = false;
+    int slot = t.first_slot;
+
+    t.skipped_bytes = 0;
+    t.resyncs = 0;
+    while(p < end && last-p >= packet_size){
+        if(!checkCRC4(p, packet_size)){     //Resynchronize with the next valid packet
+            if(!resyncing){
+                t.resyncs++;
+                resyncing = true;
+            }
+            p++;
+            t.skipped_bytes++;
+            continue;
+        }
+        resyncing = false;
+
+        decodePacket(p, packet_size, chs, num_chs, out.seq[slot], out.digital[slot], &out.raw[slot], out.capacity);
+        p += packet_size;
+        slot++;
+    }
+    if(p < end)   t.skipped_bytes += end-p;     //The tail of the data, shorter than a packet
+    t.stop = std::max(p, end) - data;
+    t.num_frames = slot - t.first_slot;
+
+    for(int i = 0; i < num_chs; i++){
+        const int32_t *raw = out.rawCh(i);
+        int32_t *mv = out.mvCh(i);
+        for(int n = t.first_slot; n < slot; n++)
+            mv[n] = rawToValue(chs[i], raw[n], &adc_chars);
+    }
+}
+
+/*****************************************************************************/
+
+int BulkDecoder::decode(const uint8_t *data, size_t len, Block &out){
+    std::vector<Task> tasks;
+
+    if(len/packet_size > INT_MAX)   return -1;
+
+    //Each task holds at most its bytes divided by the packet size frames, and the packet across its end
+    size_t begin = syncPoint(data, len, 0);
+    skipped_bytes = begin;
+    int slots = 0;
+    while(begin < len){
+        Task t;
+        t.begin = begin;
+        t.end = len;
+        if(len-begin > BULK_TASK_BYTES){
+            //Whole packets after the task start keep the phase of clean data, where a byte by byte search could
+            //lock onto another one, e.g. with flat inputs
+            t.end = begin + BULK_TASK_BYTES/packet_size*packet_size;
+            if(!synced(data, len, t.end))   t.end = syncPoint(data, len, t.end);
+        }
+        t.first_slot = slots;
+        slots += (t.end-t.begin)/packet_size + 1;
+        tasks.push_back(t);
+        begin = t.end;
+    }
+
+    const double sample_rate = out.sample_rate;
+    out.resize(num_chs, slots);
+    memcpy(out.chs, chs, sizeof(chs));
+    out.sample_rate = sample_rate;
+
+    std::atomic<size_t> next_task(0);
+    std::vector<std::thread> workers;
+    for(size_t i = 0; i < (size_t)threads && i < tasks.size(); i++){
+        workers.push_back(std::thread([&]()
+        {
+            for(size_t k = next_task++; k < tasks.size(); k = next_task++)
+                decodeTask(data, len, tasks[k], out);
+        }));
+    }
+    for(size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    //Stitch the frames of the tasks in order, each one moves to the end of the previous one
+    int num_frames = 0;
+    resyncs = 0;
+    for(size_t k = 0; k < tasks.size(); k++){
+        Task &t = tasks[k];
+
+        //A sequential decode reaches this task where the previous one stopped
+        if(k > 0 && tasks[k-1].stop != t.begin){
+            t.begin = std::min(tasks[k-1].stop, t.end);
+            decodeTask(data, len, t, out);
+        }
+        if(t.first_slot != num_frames && t.num_frames > 0){
+            memmove(&out.seq[num_frames], &out.seq[t.first_slot], t.num_frames);
+            memmove(&out.digital[num_frames], &out.digital[t.first_slot], t.num_frames);
+            for(int i = 0; i < num_chs; i++){
+                memmove(out.rawCh(i) + num_frames, out.rawCh(i) + t.first_slot, t.num_frames*sizeof(int32_t));
+                memmove(out.mvCh(i) + num_frames, out.mvCh(i) + t.first_slot, t.num_frames*sizeof(int32_t));
+            }
+        }
+        num_frames += t.num_frames;
+        skipped_bytes += t.skipped_bytes;
+        resyncs += t.resyncs;
+    }
+    out.num_frames = num_frames;
+
+    return num_frames;
+}
+
+/*****************************************************************************/
+
+bool BulkDecoder::decodeCapture(const char *file_name, Block &out, int threads){
+    CaptureHeader header;
+    std::vector<uint8_t> data;
+
+    if(!readCapture(file_name, header, data))   return false;
+    if(header.api_mode != API_MODE_SCIENTISST){
+        printf("%s was not captured with the binary API\n", file_name);
+        return false;
+    }
+
+    //The device sends the channels of the live mode mask in ascending order
+    std::vector<int> channels;
+    for(int ch = AI1; ch <= AX2; ch++){
+        if((header.live_cmd >> 8) & (1 << (ch-1)))
+            channels.push_back(ch);
+    }
+
+    BulkDecoder decoder(channels, header.adc_chars, threads);
+    out.sample_rate = header.sr_cmd >> 8;
+    return decoder.decode(data.data(), data.size(), out) >= 0;
+}
@@ -0,0 +1,66 @@
+#ifndef _BULK_H
+#define _BULK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "block.h"
+#include "esp_adc.h"
+
+#define BULK_TASK_BYTES     (4*1024*1024)   //Raw bytes decoded by one task
+#define BULK_SYNC_PACKETS   4               //Consecutive valid packets taken as the packet boundary a task starts at
+
+// Decodes large amounts of raw packets of the binary API offline, such as the bytes of a capture, on all cores.
+// The data is split in tasks of about BULK_TASK_BYTES. Each task starts a whole number of packets after the
+// previous one if BULK_SYNC_PACKETS valid packets are there, or else at the next BULK_SYNC_PACKETS consecutive
+// valid packets. Within a task the packets are decoded as ScientISST::read() does, skipping a byte at a time
+// after a CRC failure, up to the first packet boundary at or past the start of the next task. The threads take
+// the next task as they finish one. A task that didn't start where the previous one stopped, as after a resync
+// to another phase, is decoded again from there, so the frames stitched in order into a single block are those
+// of a sequential decode.
+class BulkDecoder
+{
+public:
+    /** \param[in] channels Channels of the data, in the order given to ScientISST::start(). All channels if empty.
+        * \param[in] _adc_chars ADC characteristics of the device, for the conversion to mV
+        * \param[in] _threads Decoding threads, 0 for one per core
+        * \exception ScientISST::Exception (Exception::INVALID_PARAMETER)
+        */
+    BulkDecoder(const std::vector<int> &channels, const esp_adc_cal_characteristics_t &_adc_chars, int _threads = 0);
+
+    /** Decodes the whole packets in data into out, resized to hold them. The sample rate of out is left as it is.
+        * \return Number of frames decoded, or -1 if data holds more frames than a block can
+        */
+    int decode(const uint8_t *data, size_t len, Block &out);
+
+    /** Decodes all the bytes of a capture, see ScientISST::capture(), with its channels and adc characteristics.
+        * \return false if the file cannot be read or it was not captured with the binary API
+        */
+    static bool decodeCapture(const char *file_name, Block &out, int threads = 0);
+
+    int packet_size;
+    int64_t skipped_bytes;      ///< Bytes of the last decode() that were not part of a valid packet
+    int64_t resyncs;            ///< Times the last decode() lost the packet boundary
+
+private:
+    struct Task
+    {
+        size_t begin, end;      //Bytes of the task, begin is a packet boundary
+        size_t stop;            //Where decoding stopped, at or past end
+        int first_slot;         //Frame of the output block the task decodes to
+        int num_frames;
+        int64_t skipped_bytes;
+        int64_t resyncs;
+    };
+
+    size_t syncPoint(const uint8_t *data, size_t len, size_t from) const;
+    bool synced(const uint8_t *data, size_t len, size_t at) const;
+    void decodeTask(const uint8_t *data, size_t len, Task &t, Block &out) const;
+
+    int num_chs;
+    int chs[8];
+    esp_adc_cal_characteristics_t adc_chars;
+    int threads;
+};
+
+#endif
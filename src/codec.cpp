@@ -0,0 +1,310 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include "codec.h"
+
+#ifndef MSG_NOSIGNAL    //Mac OS
+#define MSG_NOSIGNAL 0
+#endif
+
+size_t Codec::maxEncodedSize(int n){
+    return (n+CODEC_GROUP-1)/CODEC_GROUP + n*sizeof(uint32_t);
+}
+
+/*****************************************************************************/
+
+template <typename T>
+size_t Codec::encode(const T *values, int n, uint8_t *out){
+    uint32_t zz[CODEC_GROUP];
+    uint8_t *p = out;
+    int32_t prev = 0;
+
+    for(int g = 0; g < n; g += CODEC_GROUP){
+        const T *v = values+g;
+        const int len = std::min(CODEC_GROUP, n-g);
+        uint32_t bits;
+
+        //Differences and zigzag mapping, the loop has no dependencies between iterations so it is vectorized
+        uint32_t d = (uint32_t)(int32_t)v[0] - (uint32_t)prev;
+        zz[0] = (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+        bits = zz[0];
+        for(int i = 1; i < len; i++){
+            d = (uint32_t)(int32_t)v[i] - (uint32_t)(int32_t)v[i-1];
+            zz[i] = (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+            bits |= zz[i];
+        }
+        prev = v[len-1];
+
+        const int width = bits ? 32-__builtin_clz(bits) : 0;
+        *p++ = width;
+
+        uint64_t acc = 0;
+        int num_bits = 0;
+        for(int i = 0; i < len; i++){
+            acc |= (uint64_t)zz[i] << num_bits;
+            num_bits += width;
+            while(num_bits >= 8){
+                *p++ = (uint8_t)acc;
+                acc >>= 8;
+                num_bits -= 8;
+            }
+        }
+        if(num_bits > 0)   *p++ = (uint8_t)acc;
+    }
+
+    return p-out;
+}
+
+/*****************************************************************************/
+
+template <typename T>
+const uint8_t* Codec::decode(const uint8_t *in, const uint8_t *end, int n, T *values){
+    int32_t prev = 0;
+
+    for(int g = 0; g < n; g += CODEC_GROUP){
+        const int len = std::min(CODEC_GROUP, n-g);
+
+        if(in == end)   return NULL;
+        const int width = *in++;
+        if(width > 32 || (end-in) < ((long)len*width+7)/8)   return NULL;
+
+        const uint64_t mask = ((uint64_t)1 << width)-1;
+        uint64_t acc = 0;
+        int num_bits = 0;
+        for(int i = 0; i < len; i++){
+            while(num_bits < width){
+                acc |= (uint64_t)*in++ << num_bits;
+                num_bits += 8;
+            }
+            const uint32_t z = (uint32_t)(acc & mask);
+            acc >>= width;
+            num_bits -= width;
+
+            prev = (int32_t)((uint32_t)prev + ((z >> 1) ^ (0u-(z & 1))));
+            values[g+i] = (T)prev;
+        }
+    }
+
+    return in;
+}
+
+template size_t Codec::encode<uint8_t>(const uint8_t*, int, uint8_t*);
+template size_t Codec::encode<int32_t>(const int32_t*, int, uint8_t*);
+template const uint8_t* Codec::decode<uint8_t>(const uint8_t*, const uint8_t*, int, uint8_t*);
+template const uint8_t* Codec::decode<int32_t>(const uint8_t*, const uint8_t*, int, int32_t*);
+
+/*****************************************************************************/
+
+void Codec::encodeHeader(const Block &layout, std::vector<uint8_t> &out){
+    const uint32_t header[3] = {CODEC_MAGIC, CODEC_VERSION, (uint32_t)layout.num_chs};
+    const size_t start = out.size();
+
+    out.resize(start + sizeof(header) + sizeof(layout.sample_rate) + layout.num_chs*sizeof(layout.chs[0]));
+    memcpy(&out[start], header, sizeof(header));
+    memcpy(&out[start+sizeof(header)], &layout.sample_rate, sizeof(layout.sample_rate));
+    memcpy(&out[start+sizeof(header)+sizeof(layout.sample_rate)], layout.chs, layout.num_chs*sizeof(layout.chs[0]));
+}
+
+/*****************************************************************************/
+
+void Codec::encodeBlock(const Block &b, std::vector<uint8_t> &out){
+    const size_t start = out.size();
+    const uint32_t num_frames = b.num_frames;
+
+    out.resize(start + 2*sizeof(uint32_t) + (2+2*b.num_chs)*maxEncodedSize(b.num_frames));
+    uint8_t *p = &out[start+2*sizeof(uint32_t)];
+
+    memcpy(&out[start+sizeof(uint32_t)], &num_frames, sizeof(num_frames));
+    p += encode(&b.seq[0], b.num_frames, p);
+    p += encode(&b.digital[0], b.num_frames, p);
+    for(int i = 0; i < b.num_chs; i++)
+        p += encode(b.rawCh(i), b.num_frames, p);
+    for(int i = 0; i < b.num_chs; i++)
+        p += encode(b.mvCh(i), b.num_frames, p);
+
+    const uint32_t size = p - &out[start+sizeof(uint32_t)];
+    memcpy(&out[start], &size, sizeof(size));
+    out.resize(start + sizeof(uint32_t) + size);
+}
+
+/*****************************************************************************/
+
+bool Codec::decodeBlock(const uint8_t *data, size_t size, Block &b){
+    const uint8_t *end = data+size;
+    uint32_t num_frames;
+
+    if(size < sizeof(num_frames))   return false;
+    memcpy(&num_frames, data, sizeof(num_frames));
+    if(num_frames > (uint32_t)b.capacity)   return false;
+
+    const uint8_t *p = data+sizeof(num_frames);
+    p = decode(p, end, num_frames, &b.seq[0]);
+    if(p)   p = decode(p, end, num_frames, &b.digital[0]);
+    for(int i = 0; i < b.num_chs && p; i++)
+        p = decode(p, end, num_frames, b.rawCh(i));
+    for(int i = 0; i < b.num_chs && p; i++)
+        p = decode(p, end, num_frames, b.mvCh(i));
+    if(p != end)   return false;
+
+    b.num_frames = num_frames;
+    return true;
+}
+
+/*****************************************************************************/
+
+void CodecSink::open(const Block &layout){
+    close();
+
+    if(!file.open(file_name.c_str(), config)){
+        printf("Output file cannot be opened.");
+        exit(-1);
+    }
+
+    encoded.clear();
+    Codec::encodeHeader(layout, encoded);
+    file.header(&encoded[0], encoded.size());
+}
+
+/*****************************************************************************/
+
+void CodecSink::write(const Block &b){
+    encoded.clear();
+    Codec::encodeBlock(b, encoded);
+    file.write(&encoded[0], encoded.size());
+}
+
+/*****************************************************************************/
+
+void CodecSink::gap(int gap_ms, int missing_frames){
+    uint32_t record[3] = {CODEC_GAP, (uint32_t)gap_ms, (uint32_t)missing_frames};
+
+    file.write(record, sizeof(record));
+}
+
+/*****************************************************************************/
+
+void CodecSink::close(void){
+    file.close();
+}
+
+/*****************************************************************************/
+
+FanoutSink::~FanoutSink(){
+    for(size_t i = 0; i < subscribers.size(); i++)
+        ::close(subscribers[i].fd);
+    if(listen_fd >= 0)   ::close(listen_fd);
+}
+
+/*****************************************************************************/
+
+bool FanoutSink::listen(int port){
+    struct sockaddr_in addr;
+    int opt = 1;
+
+    if(listen_fd >= 0)   ::close(listen_fd);
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(listen_fd < 0){
+        perror("socket");
+        return false;
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if(bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(listen_fd, FANOUT_BACKLOG) < 0){
+        perror("fanout");
+        ::close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+
+    return true;
+}
+
+/*****************************************************************************/
+
+void FanoutSink::open(const Block &layout){
+    header.clear();
+    accept();
+
+    Codec::encodeHeader(layout, header);
+    send(header);
+}
+
+/*****************************************************************************/
+
+void FanoutSink::write(const Block &b){
+    accept();
+
+    encoded.clear();
+    Codec::encodeBlock(b, encoded);
+    send(encoded);
+}
+
+/*****************************************************************************/
+
+void FanoutSink::gap(int gap_ms, int missing_frames){
+    uint32_t record[3] = {CODEC_GAP, (uint32_t)gap_ms, (uint32_t)missing_frames};
+
+    encoded.assign((uint8_t*)record, (uint8_t*)record + sizeof(record));
+    send(encoded);
+}
+
+/*****************************************************************************/
+
+// Takes the subscribers waiting on the port. Those joining during an acquisition get the stream header first.
+void FanoutSink::accept(void){
+    if(listen_fd < 0)   return;
+
+    while(1){
+        int fd = ::accept(listen_fd, NULL, NULL);
+        if(fd < 0)   return;
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+
+        Subscriber s;
+        s.fd = fd;
+        s.pending = header;     //Empty before the first acquisition, the header is sent by open()
+        subscribers.push_back(s);
+    }
+}
+
+/*****************************************************************************/
+
+// Queues data for every subscriber and sends as much as their sockets take without blocking.
+void FanoutSink::send(const std::vector<uint8_t> &data){
+    for(size_t i = 0; i < subscribers.size();){
+        Subscriber &s = subscribers[i];
+
+        s.pending.insert(s.pending.end(), data.begin(), data.end());
+
+        bool drop = s.pending.size() > FANOUT_MAX_PENDING;
+        while(!drop && !s.pending.empty()){
+            ssize_t ret = ::send(s.fd, &s.pending[0], s.pending.size(), MSG_NOSIGNAL);
+            if(ret < 0){
+                if(errno == EAGAIN || errno == EWOULDBLOCK)   break;
+                drop = true;
+            }else{
+                s.pending.erase(s.pending.begin(), s.pending.begin()+ret);
+            }
+        }
+
+        if(drop){
+            ::close(s.fd);
+            subscribers.erase(subscribers.begin()+i);
+            continue;
+        }
+        i++;
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef _CODEC_H
+#define _CODEC_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "sink.h"
+
+#define CODEC_GROUP         128             //Values packed with the same bit width
+#define CODEC_MAGIC         0x43434353      //"SCCC" read as a little endian integer
+#define CODEC_VERSION       1
+#define CODEC_GAP           0xFFFFFFFF      //Size of a record marking a link loss
+
+#define FANOUT_BACKLOG      8
+#define FANOUT_MAX_PENDING  (4*1024*1024)   //Bytes queued for a slow subscriber before it is dropped
+
+// Lossless codec of the sample stream. Each column is replaced by the differences between consecutive values,
+// zigzag mapped to small unsigned numbers and bit-packed in groups of CODEC_GROUP values with the width of the
+// largest one: a byte with the width, then the bits of each value, least significant first.
+// A full group of a width w takes 16*w+1 bytes, so a quiet biosignal needs a few bits per sample.
+//
+// Streams (files written by CodecSink and the connections of FanoutSink), in host byte order:
+//   header: uint32 CODEC_MAGIC, uint32 CODEC_VERSION, uint32 num_chs, double sample_rate, int32 chs[num_chs]
+//   block:  uint32 size and size bytes: uint32 num_frames, then the encoded columns seq, digital,
+//           raw of each channel and mV of each channel
+//   gap:    uint32 CODEC_GAP, int32 gap_ms, int32 missing_frames
+class Codec
+{
+public:
+    /// Upper bound of the bytes encode() writes for n values.
+    static size_t maxEncodedSize(int n);
+
+    /// Encodes n values at out, returns the number of bytes written.
+    template <typename T>
+    static size_t encode(const T *values, int n, uint8_t *out);
+
+    /// Decodes n values from [in, end), returns the end of the encoded data or NULL if it is truncated.
+    template <typename T>
+    static const uint8_t* decode(const uint8_t *in, const uint8_t *end, int n, T *values);
+
+    /// Appends the stream header for blocks of the given layout to out.
+    static void encodeHeader(const Block &layout, std::vector<uint8_t> &out);
+
+    /// Appends a block record to out.
+    static void encodeBlock(const Block &b, std::vector<uint8_t> &out);
+
+    /** Decodes the size bytes of a block record, after its size field, into b.
+        * b must already be sized for the layout of the stream header and hold at least num_frames frames.
+        * \return false if the data is damaged or does not fit in b
+        */
+    static bool decodeBlock(const uint8_t *data, size_t size, Block &b);
+};
+
+// Writes the blocks to a file in the codec stream format.
+class CodecSink : public Sink
+{
+public:
+    CodecSink(const char *_file_name, const WriterConfig &_config = WriterConfig()) : file_name(_file_name), config(_config) {}
+    virtual ~CodecSink() { close(); }
+
+    virtual void open(const Block &layout);
+    virtual void write(const Block &b);
+    virtual void gap(int gap_ms, int missing_frames);
+    virtual void close(void);
+
+private:
+    std::string file_name;
+    WriterConfig config;
+    FileWriter file;
+    std::vector<uint8_t> encoded;
+};
+
+// Sends the blocks in the codec stream format to every TCP client connected to a port. Each block is encoded
+// once for all subscribers. Subscribers joining during an acquisition get the stream header first, subscribers
+// that fall more than FANOUT_MAX_PENDING bytes behind are disconnected.
+class FanoutSink : public Sink
+{
+public:
+    FanoutSink(void) : listen_fd(-1) {}
+    virtual ~FanoutSink();
+
+    /// Starts accepting subscribers on a TCP port, returns false if it cannot be used.
+    bool listen(int port);
+
+    virtual void open(const Block &layout);
+    virtual void write(const Block &b);
+    virtual void gap(int gap_ms, int missing_frames);
+
+private:
+    struct Subscriber
+    {
+        int fd;
+        std::vector<uint8_t> pending;   //Bytes the socket did not take yet
+    };
+
+    void accept(void);
+    void send(const std::vector<uint8_t> &data);
+
+    int listen_fd;
+    std::vector<Subscriber> subscribers;
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> encoded;
+};
+
+#endif
@@ -0,0 +1,341 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include "codec.h"
+#include "columnar.h"
+
+#define COLUMNAR_TRAILER_SIZE   16
+
+// Appends a column: encoding, size and the values bit-packed by Codec.
+template <typename T>
+static void appendColumn(std::vector<uint8_t> &out, const T *values, int n){
+    const size_t start = out.size();
+
+    out.resize(start+1+sizeof(uint32_t)+Codec::maxEncodedSize(n));
+    out[start] = COLUMNAR_ENC_BITPACK;
+
+    const uint32_t size = Codec::encode(values, n, &out[start+1+sizeof(uint32_t)]);
+    memcpy(&out[start+1], &size, sizeof(size));
+    out.resize(start+1+sizeof(uint32_t)+size);
+}
+
+/*****************************************************************************/
+
+// Decodes values [from, from+count) of the column at p into out. Returns the end of the column, NULL if it is damaged.
+template <typename T>
+static const uint8_t* readColumn(const uint8_t *p, const uint8_t *end, uint32_t from, uint32_t count, T *out){
+    uint32_t size;
+    int32_t value = 0;
+
+    if(end-p < (long)(1+sizeof(size)))   return NULL;
+    const uint8_t encoding = *p;
+    memcpy(&size, p+1, sizeof(size));
+    p += 1+sizeof(size);
+    if((uint32_t)(end-p) < size)   return NULL;
+    end = p+size;
+
+    if(encoding == COLUMNAR_ENC_BITPACK){
+        //Groups depend on the previous value, so the column is decoded from its start
+        std::vector<T> values(from+count);
+        if(!Codec::decode(p, end, from+count, &values[0]))   return NULL;
+        std::copy(values.begin()+from, values.end(), out);
+        return end;
+    }
+    if(encoding != COLUMNAR_ENC_DELTA_VARINT)   return NULL;
+
+    const uint8_t *q = p;
+    for(uint32_t i = 0; i < from+count; i++){
+        uint32_t v = 0;
+        int shift = 0;
+        do{
+            if(q == end || shift > 28)   return NULL;
+            v |= (uint32_t)(*q & 0x7F) << shift;
+            shift += 7;
+        }while(*q++ & 0x80);
+
+        value = (int32_t)((uint32_t)value + ((v >> 1) ^ (0u-(v & 1))));
+        if(i >= from)   out[i-from] = value;
+    }
+
+    return end;
+}
+
+/*****************************************************************************/
+
+static int64_t nowUs(void){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*****************************************************************************/
+
+ColumnarSink::ColumnarSink(const char *_file_name, int _chunk_frames, const WriterConfig &_config){
+    file_name = _file_name;
+    chunk_frames = _chunk_frames > 0 ? _chunk_frames : COLUMNAR_CHUNK_FRAMES;
+    config = _config;
+    config.rotate_bytes = 0;
+    config.rotate_s = 0;
+    offset = 0;
+    num_frames = 0;
+    sample_rate = 0;
+    chunk_time_us = 0;
+}
+
+/*****************************************************************************/
+
+void ColumnarSink::open(const Block &layout){
+    uint32_t header[3] = {COLUMNAR_MAGIC, COLUMNAR_VERSION, (uint32_t)layout.num_chs};
+
+    close();
+
+    if(!file.open(file_name.c_str(), config)){
+        printf("Output file cannot be opened.");
+        exit(-1);
+    }
+
+    file.write(header, sizeof(header));
+    file.write(&layout.sample_rate, sizeof(layout.sample_rate));
+    file.write(layout.chs, layout.num_chs*sizeof(layout.chs[0]));
+
+    offset = sizeof(header) + sizeof(layout.sample_rate) + layout.num_chs*sizeof(layout.chs[0]);
+    num_frames = 0;
+    sample_rate = layout.sample_rate;
+    index.clear();
+
+    chunk.resize(layout.num_chs, chunk_frames);
+    memcpy(chunk.chs, layout.chs, sizeof(chunk.chs));
+    chunk.sample_rate = layout.sample_rate;
+}
+
+/*****************************************************************************/
+
+void ColumnarSink::write(const Block &b){
+    const int64_t end_us = nowUs();    //Host time of the last frame of the block
+
+    for(int n = 0; n < b.num_frames;){
+        if(chunk.num_frames == 0){
+            chunk_time_us = end_us - (int64_t)((b.num_frames-1-n)*1e6/sample_rate);
+
+            //Keep the index sorted by time when blocks arrive faster than the sample rate, after a burst
+            if(!index.empty()){
+                const ColumnarChunk &prev = index.back();
+                chunk_time_us = std::max(chunk_time_us, prev.first_time_us + (int64_t)(prev.num_frames*1e6/sample_rate));
+            }
+        }
+
+        const int count = std::min(b.num_frames-n, chunk_frames-chunk.num_frames);
+        const int at = chunk.num_frames;
+
+        memcpy(&chunk.seq[at], &b.seq[n], count);
+        memcpy(&chunk.digital[at], &b.digital[n], count);
+        for(int i = 0; i < b.num_chs; i++){
+            memcpy(chunk.rawCh(i)+at, b.rawCh(i)+n, count*sizeof(int32_t));
+            memcpy(chunk.mvCh(i)+at, b.mvCh(i)+n, count*sizeof(int32_t));
+        }
+
+        chunk.num_frames += count;
+        n += count;
+        if(chunk.num_frames == chunk_frames)   flushChunk();
+    }
+}
+
+/*****************************************************************************/
+
+void ColumnarSink::gap(int gap_ms, int missing_frames){
+    //The frames after the gap start a new chunk, with their own host time
+    flushChunk();
+}
+
+/*****************************************************************************/
+
+void ColumnarSink::close(void){
+    uint64_t index_offset;
+    uint32_t trailer[2];
+
+    if(!file.isOpen())   return;
+
+    flushChunk();
+    index_offset = offset;
+
+    trailer[0] = index.size();
+    trailer[1] = COLUMNAR_INDEX_MAGIC;
+    if(!index.empty())
+        file.write(&index[0], index.size()*sizeof(ColumnarChunk));
+    file.write(&index_offset, sizeof(index_offset));
+    file.write(trailer, sizeof(trailer));
+
+    file.close();
+}
+
+/*****************************************************************************/
+
+void ColumnarSink::flushChunk(void){
+    ColumnarChunk c;
+
+    if(!file.isOpen() || chunk.num_frames == 0)   return;
+
+    encoded.clear();
+    appendColumn(encoded, &chunk.seq[0], chunk.num_frames);
+    appendColumn(encoded, &chunk.digital[0], chunk.num_frames);
+    for(int i = 0; i < chunk.num_chs; i++)
+        appendColumn(encoded, chunk.rawCh(i), chunk.num_frames);
+    for(int i = 0; i < chunk.num_chs; i++)
+        appendColumn(encoded, chunk.mvCh(i), chunk.num_frames);
+
+    file.write(&encoded[0], encoded.size());
+
+    c.offset = offset;
+    c.first_frame = num_frames;
+    c.first_time_us = chunk_time_us;
+    c.size = encoded.size();
+    c.num_frames = chunk.num_frames;
+    index.push_back(c);
+
+    offset += c.size;
+    num_frames += c.num_frames;
+    chunk.num_frames = 0;
+}
+
+/*****************************************************************************/
+
+bool ColumnarReader::open(const char *file_name){
+    uint32_t header[3];
+    uint64_t index_offset;
+    uint32_t trailer[2];
+    struct stat st;
+
+    close();
+
+    fd = ::open(file_name, O_RDONLY);
+    if(fd < 0)   return false;
+
+    if(pread(fd, header, sizeof(header), 0) != sizeof(header) || header[0] != COLUMNAR_MAGIC || header[1] != COLUMNAR_VERSION || header[2] > 8 ||
+       pread(fd, &sample_rate, sizeof(sample_rate), sizeof(header)) != sizeof(sample_rate) ||
+       pread(fd, chs, header[2]*sizeof(chs[0]), sizeof(header)+sizeof(sample_rate)) != (ssize_t)(header[2]*sizeof(chs[0]))){
+        close();
+        return false;
+    }
+    num_chs = header[2];
+
+    //The index is found through the trailer, a recording that was not closed has none
+    if(fstat(fd, &st) != 0 || st.st_size < COLUMNAR_TRAILER_SIZE ||
+       pread(fd, &index_offset, sizeof(index_offset), st.st_size-COLUMNAR_TRAILER_SIZE) != sizeof(index_offset) ||
+       pread(fd, trailer, sizeof(trailer), st.st_size-sizeof(trailer)) != sizeof(trailer) ||
+       trailer[1] != COLUMNAR_INDEX_MAGIC ||
+       index_offset + (uint64_t)trailer[0]*sizeof(ColumnarChunk) + COLUMNAR_TRAILER_SIZE != (uint64_t)st.st_size){
+        close();
+        return false;
+    }
+
+    index.resize(trailer[0]);
+    if(!index.empty() && pread(fd, &index[0], index.size()*sizeof(ColumnarChunk), index_offset) != (ssize_t)(index.size()*sizeof(ColumnarChunk))){
+        close();
+        return false;
+    }
+
+    num_frames = index.empty() ? 0 : index.back().first_frame + index.back().num_frames;
+    return true;
+}
+
+/*****************************************************************************/
+
+void ColumnarReader::close(void){
+    if(fd >= 0)   ::close(fd);
+    fd = -1;
+    num_chs = 0;
+    num_frames = 0;
+    index.clear();
+}
+
+/*****************************************************************************/
+
+static bool chunkBefore(uint64_t frame, const ColumnarChunk &c){
+    return frame < c.first_frame;
+}
+
+int ColumnarReader::readFrames(uint64_t first, int count, Block &b){
+    int num_read = 0;
+
+    if(fd < 0 || first >= num_frames || count <= 0){
+        b.num_frames = 0;
+        return 0;
+    }
+    count = (int)std::min<uint64_t>(count, num_frames-first);
+
+    b.resize(num_chs, count);
+    memcpy(b.chs, chs, sizeof(b.chs));
+    b.sample_rate = sample_rate;
+
+    //Chunk holding the first frame, then the following ones
+    std::vector<ColumnarChunk>::const_iterator it = std::upper_bound(index.begin(), index.end(), first, chunkBefore) - 1;
+    for(; it != index.end() && num_read < count; it++){
+        const uint32_t from = first+num_read-it->first_frame;
+        const uint32_t n = std::min<uint32_t>(it->num_frames-from, count-num_read);
+
+        if(decodeChunk(*it, from, n, b, num_read) != (int)n)   break;
+        num_read += n;
+    }
+
+    b.num_frames = num_read;
+    return num_read;
+}
+
+/*****************************************************************************/
+
+int ColumnarReader::readTime(int64_t start_us, int64_t end_us, Block &b){
+    const uint64_t first = frameAt(start_us);
+    const uint64_t last = frameAt(end_us);
+
+    if(last <= first){
+        b.num_frames = 0;
+        return 0;
+    }
+    return readFrames(first, (int)std::min<uint64_t>(last-first, 0x7FFFFFFF), b);
+}
+
+/*****************************************************************************/
+
+static bool timeBefore(int64_t t_us, const ColumnarChunk &c){
+    return t_us < c.first_time_us;
+}
+
+uint64_t ColumnarReader::frameAt(int64_t t_us) const{
+    std::vector<ColumnarChunk>::const_iterator it = std::upper_bound(index.begin(), index.end(), t_us, timeBefore);
+    if(it == index.begin())   return 0;
+    it--;
+
+    const double k = (t_us - it->first_time_us)*sample_rate/1e6;
+    if(k >= it->num_frames)   return it->first_frame + it->num_frames;     //In a gap or past the end
+
+    return it->first_frame + (uint64_t)ceil(k);
+}
+
+/*****************************************************************************/
+
+// Maps chunk c and decodes its frames [from, from+count) into b, at frame at.
+int ColumnarReader::decodeChunk(const ColumnarChunk &c, uint32_t from, uint32_t count, Block &b, int at){
+    const long page = sysconf(_SC_PAGESIZE);
+    const off_t map_offset = c.offset - c.offset % page;
+    const size_t map_size = c.size + (c.offset - map_offset);
+
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+    if(map == MAP_FAILED)   return 0;
+
+    const uint8_t *p = (const uint8_t*)map + (c.offset - map_offset);
+    const uint8_t *end = p + c.size;
+
+    p = readColumn(p, end, from, count, &b.seq[at]);
+    if(p)   p = readColumn(p, end, from, count, &b.digital[at]);
+    for(int i = 0; i < num_chs && p; i++)
+        p = readColumn(p, end, from, count, b.rawCh(i)+at);
+    for(int i = 0; i < num_chs && p; i++)
+        p = readColumn(p, end, from, count, b.mvCh(i)+at);
+
+    munmap(map, map_size);
+    return p ? count : 0;
+}
@@ -0,0 +1,100 @@
+#ifndef _COLUMNAR_H
+#define _COLUMNAR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sink.h"
+
+#define COLUMNAR_MAGIC          0x52434353      //"SCCR" read as a little endian integer
+#define COLUMNAR_INDEX_MAGIC    0x49434353      //"SCCI"
+#define COLUMNAR_VERSION        1
+#define COLUMNAR_CHUNK_FRAMES   10000           //Frames per chunk, 10 s at 1 kHz
+
+#define COLUMNAR_ENC_DELTA_VARINT   1           //Differences to the previous value, zigzag and LEB128 encoded
+#define COLUMNAR_ENC_BITPACK        2           //Codec::encode(), differences zigzag encoded and bit-packed
+
+// Chunked columnar recording, in host byte order:
+//   header:  uint32 COLUMNAR_MAGIC, uint32 COLUMNAR_VERSION, uint32 num_chs, double sample_rate, int32 chs[num_chs]
+//   chunks:  one column after the other: seq, digital, raw of each channel, mV of each channel,
+//            each as uint8 encoding, uint32 size and size bytes of data
+//   index:   a ColumnarChunk per chunk
+//   trailer: uint64 index offset, uint32 number of chunks, uint32 COLUMNAR_INDEX_MAGIC
+// A chunk is closed when it is full and at every link loss, so the host time of its first frame and
+// the sample rate give the host time of each of its frames.
+struct ColumnarChunk
+{
+    uint64_t offset;        ///< File offset of the chunk
+    uint64_t first_frame;   ///< Number of frames recorded before the chunk
+    int64_t first_time_us;  ///< Host time of the first frame, in us since the epoch
+    uint32_t size;          ///< Bytes of the chunk
+    uint32_t num_frames;    ///< Frames in the chunk
+};
+
+// Records the blocks in the chunked columnar format.
+class ColumnarSink : public Sink
+{
+public:
+    /// \param[in] _config Checkpoints of the file. Rotation is ignored, the index is only valid for a whole file.
+    ColumnarSink(const char *_file_name, int _chunk_frames = COLUMNAR_CHUNK_FRAMES, const WriterConfig &_config = WriterConfig());
+    virtual ~ColumnarSink() { close(); }
+
+    virtual void open(const Block &layout);
+    virtual void write(const Block &b);
+    virtual void gap(int gap_ms, int missing_frames);
+    virtual void close(void);
+
+private:
+    void flushChunk(void);
+
+    std::string file_name;
+    int chunk_frames;
+    WriterConfig config;
+    FileWriter file;
+    uint64_t offset;
+    uint64_t num_frames;
+    double sample_rate;
+    Block chunk;                        //Frames of the chunk being filled
+    int64_t chunk_time_us;
+    std::vector<uint8_t> encoded;
+    std::vector<ColumnarChunk> index;
+};
+
+// Reads parts of a columnar recording. Only the header and the index are read when opening,
+// the chunks holding the requested frames are memory-mapped when they are read.
+class ColumnarReader
+{
+public:
+    ColumnarReader(void) : num_chs(0), sample_rate(0), num_frames(0), fd(-1) {}
+    ~ColumnarReader() { close(); }
+
+    /// Opens a recording, returns false if it cannot be read or it was not closed properly.
+    bool open(const char *file_name);
+    void close(void);
+
+    /** Reads up to count frames, starting at frame first, into b.
+        * \return Number of frames read, 0 past the end of the recording or if a chunk is damaged
+        */
+    int readFrames(uint64_t first, int count, Block &b);
+
+    /** Reads the frames received between the host times start_us (included) and end_us (excluded), in us since the epoch.
+        * \return Number of frames read
+        */
+    int readTime(int64_t start_us, int64_t end_us, Block &b);
+
+    /// Index of the first frame received at or after the host time t_us.
+    uint64_t frameAt(int64_t t_us) const;
+
+    int num_chs;
+    int chs[8];
+    double sample_rate;
+    uint64_t num_frames;                ///< Frames in the recording
+    std::vector<ColumnarChunk> index;
+
+private:
+    int decodeChunk(const ColumnarChunk &c, uint32_t from, uint32_t count, Block &b, int at);
+
+    int fd;
+};
+
+#endif
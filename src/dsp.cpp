@@ -0,0 +1,195 @@
+#include <cmath>
+#include "dsp.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*****************************************************************************/
+
+// Filter designs from the Audio EQ Cookbook (R. Bristow-Johnson)
+
+bool Dsp::configure(const DspConfig &config, int sample_rate, int _num_chs, int capacity){
+    const float nyquist = sample_rate/2.0f;
+
+    num_chs = _num_chs;
+    decimation = config.decimation;
+    phase = 0;
+    primed = false;
+    sections.clear();
+    taps.clear();
+
+    if(decimation < 1)   return false;
+    if(config.notch_hz < 0 || config.notch_hz >= nyquist || config.notch_q <= 0)   return false;
+    if(config.highpass_hz < 0 || config.highpass_hz >= nyquist)   return false;
+    if(config.lowpass_hz < 0 || config.lowpass_hz >= nyquist)   return false;
+
+    if(config.notch_hz > 0){
+        const double w0 = 2*M_PI*config.notch_hz/sample_rate;
+        const double alpha = sin(w0)/(2*config.notch_q);
+        addSection(1, -2*cos(w0), 1, 1+alpha, -2*cos(w0), 1-alpha);
+    }
+    if(config.highpass_hz > 0){
+        const double w0 = 2*M_PI*config.highpass_hz/sample_rate;
+        const double alpha = sin(w0)/(2*M_SQRT1_2);
+        addSection((1+cos(w0))/2, -(1+cos(w0)), (1+cos(w0))/2, 1+alpha, -2*cos(w0), 1-alpha);
+    }
+    if(config.lowpass_hz > 0){
+        const double w0 = 2*M_PI*config.lowpass_hz/sample_rate;
+        const double alpha = sin(w0)/(2*M_SQRT1_2);
+        addSection((1-cos(w0))/2, 1-cos(w0), (1-cos(w0))/2, 1+alpha, -2*cos(w0), 1-alpha);
+    }
+    state.assign(2*sections.size()*num_chs, 0);
+
+    //Anti-aliasing low-pass for the decimator: Blackman windowed sinc with the cutoff a bit below the new Nyquist
+    //frequency. Zeros are prepended up to a multiple of DSP_FIR_LANES, so the dot product has no remainder loop.
+    if(decimation > 1){
+        const int len = DSP_TAPS_PER_PHASE*decimation+1;
+        const int padded = (len+DSP_FIR_LANES-1)/DSP_FIR_LANES*DSP_FIR_LANES;
+        const double fc = 0.45/decimation;
+        double sum = 0;
+
+        taps.assign(padded, 0);
+        for(int k = 0; k < len; k++){
+            const double m = k-(len-1)/2.0;
+            const double sinc = (m == 0) ? 2*fc : sin(2*M_PI*fc*m)/(M_PI*m);
+            const double window = 0.42-0.5*cos(2*M_PI*k/(len-1))+0.08*cos(4*M_PI*k/(len-1));
+            taps[padded-len+k] = sinc*window;
+            sum += sinc*window;
+        }
+        for(int k = 0; k < padded; k++)   taps[k] /= sum;     //Unity gain at DC
+
+        history_len = padded-1;
+        history.assign(num_chs*(history_len+capacity), 0);
+        out.assign(capacity, 0);
+    }
+    work.assign(capacity, 0);
+
+    return true;
+}
+
+/*****************************************************************************/
+
+void Dsp::addSection(float b0, float b1, float b2, float a0, float a1, float a2){
+    Biquad s;
+
+    s.b0 = b0/a0;
+    s.b1 = b1/a0;
+    s.b2 = b2/a0;
+    s.a1 = a1/a0;
+    s.a2 = a2/a0;
+    sections.push_back(s);
+}
+
+/*****************************************************************************/
+
+void Dsp::process(Block &block){
+    const int n = block.num_frames;
+    int num_out = n;
+
+    if(n == 0)   return;
+
+    for(int c = 0; c < num_chs; c++){
+        const int32_t *in = block.mvCh(c);
+        int32_t *mv = block.mvCh(c);
+
+        for(int i = 0; i < n; i++)   work[i] = in[i];
+
+        //Start the filters in their steady state for the first value instead of from zero,
+        //otherwise the DC of the signal rings through the high-pass for seconds
+        if(!primed){
+            float x = work[0];
+            for(size_t s = 0; s < sections.size(); s++){
+                const Biquad &q = sections[s];
+                const float y = x*(q.b0+q.b1+q.b2)/(1+q.a1+q.a2);
+                float *st = &state[2*(c*sections.size()+s)];
+                st[1] = q.b2*x - q.a2*y;
+                st[0] = q.b1*x - q.a1*y + st[1];
+                x = y;
+            }
+            if(decimation > 1){
+                float *hist = &history[c*(history_len+block.capacity)];
+                for(int k = 0; k < history_len; k++)   hist[k] = x;
+            }
+        }
+
+        filterChannel(c, &work[0], n);
+
+        if(decimation > 1){
+            num_out = decimateChannel(c, &work[0], n, &out[0]);
+            for(int o = 0; o < num_out; o++)   mv[o] = lrintf(out[o]);
+        }else{
+            for(int i = 0; i < n; i++)   mv[i] = lrintf(work[i]);
+        }
+    }
+    primed = true;
+
+    //The decimated frames keep the raw values, sequence number and digital ports of the frame they were output at
+    if(decimation > 1){
+        int o = 0;
+        for(int i = 0; i < n; i++){
+            if(++phase < decimation)   continue;
+            phase = 0;
+
+            block.seq[o] = block.seq[i];
+            block.digital[o] = block.digital[i];
+            for(int c = 0; c < num_chs; c++)   block.rawCh(c)[o] = block.rawCh(c)[i];
+            o++;
+        }
+        block.num_frames = num_out;
+        block.sample_rate /= decimation;
+    }
+}
+
+/*****************************************************************************/
+
+void Dsp::filterChannel(int c, float *x, int n){
+    for(size_t s = 0; s < sections.size(); s++){
+        const Biquad q = sections[s];
+        float *st = &state[2*(c*sections.size()+s)];
+        float s1 = st[0];
+        float s2 = st[1];
+
+        for(int i = 0; i < n; i++){
+            const float y = q.b0*x[i] + s1;
+            s1 = q.b1*x[i] - q.a1*y + s2;
+            s2 = q.b2*x[i] - q.a2*y;
+            x[i] = y;
+        }
+
+        st[0] = s1;
+        st[1] = s2;
+    }
+}
+
+/*****************************************************************************/
+
+// Polyphase decimation: the FIR is only evaluated at the frames that are kept. Returns the number of outputs.
+int Dsp::decimateChannel(int c, const float *x, int n, float *y){
+    const int len = taps.size();
+    float *hist = &history[c*(history_len+(int)work.size())];
+    int p = phase;
+    int num_out = 0;
+
+    for(int i = 0; i < n; i++)   hist[history_len+i] = x[i];
+
+    for(int i = 0; i < n; i++){
+        if(++p < decimation)   continue;
+        p = 0;
+
+        //The taps are symmetric, so the newest input lines up with the last tap
+        const float *window = hist+i;
+        float acc[DSP_FIR_LANES] = {0};
+        for(int k = 0; k < len; k += DSP_FIR_LANES){
+            for(int l = 0; l < DSP_FIR_LANES; l++)   acc[l] += taps[k+l]*window[k+l];
+        }
+
+        float sum = 0;
+        for(int l = 0; l < DSP_FIR_LANES; l++)   sum += acc[l];
+        y[num_out++] = sum;
+    }
+
+    for(int k = 0; k < history_len; k++)   hist[k] = hist[n+k];
+
+    return num_out;
+}
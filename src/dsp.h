@@ -0,0 +1,63 @@
+#ifndef _DSP_H
+#define _DSP_H
+
+#include <vector>
+#include "block.h"
+
+#define DSP_TAPS_PER_PHASE  16      //FIR decimator length is DSP_TAPS_PER_PHASE*decimation taps
+#define DSP_FIR_LANES       8       //Independent partial sums of the FIR dot product, mapped to SIMD lanes by the compiler
+
+/// Configuration of the streaming filters applied by ScientISST::read(). A zero frequency disables that filter.
+struct DspConfig
+{
+    float notch_hz;         ///< Notch center, e.g. 50 or 60 Hz to remove mains interference
+    float notch_q;          ///< Notch quality factor, higher is narrower
+    float highpass_hz;      ///< 2nd order Butterworth high-pass cutoff, together with lowpass_hz makes a band-pass
+    float lowpass_hz;       ///< 2nd order Butterworth low-pass cutoff
+    int decimation;         ///< Keep one frame out of decimation, after an anti-aliasing FIR. 1 disables it
+
+    DspConfig(void) : notch_hz(0), notch_q(30), highpass_hz(0), lowpass_hz(0), decimation(1) {}
+};
+
+// Per channel cascade of biquad IIR sections followed by a polyphase FIR decimator, processing
+// whole Blocks in place. The filters run on the mV values, state carries over from block to block.
+class Dsp
+{
+public:
+    Dsp(void) : num_chs(0), decimation(1), phase(0) {}
+
+    /** Designs the filters and allocates all state, so process() doesn't allocate.
+        * \return false if a frequency is not below the Nyquist frequency or the decimation is invalid
+        */
+    bool configure(const DspConfig &config, int sample_rate, int _num_chs, int capacity);
+
+    /// True if configure() set up at least one filter or decimation.
+    bool enabled(void) const { return !sections.empty() || decimation > 1; }
+
+    /// Filters the block and, when decimating, replaces its contents with the decimated frames.
+    void process(Block &block);
+
+private:
+    struct Biquad   //Transposed direct form II, normalized so a0 = 1
+    {
+        float b0, b1, b2, a1, a2;
+    };
+
+    void addSection(float b0, float b1, float b2, float a0, float a1, float a2);
+    void filterChannel(int c, float *x, int n);
+    int decimateChannel(int c, const float *x, int n, float *y);
+
+    int num_chs;
+    int decimation;
+    int phase;                          //Input frames since the last decimator output
+    bool primed;                        //Filter states were initialized from the first frame
+    std::vector<Biquad> sections;
+    std::vector<float> state;           //2 per section per channel
+    std::vector<float> taps;            //FIR coefficients, DSP_FIR_LANES aligned length
+    std::vector<float> history;         //Last taps.size() inputs per channel, followed by room for a block
+    std::vector<float> work;            //One channel of the block being processed
+    std::vector<float> out;
+    int history_len;
+};
+
+#endif
@@ -0,0 +1,329 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cstdio>
+#include <memory>
+#include "eventloop.h"
+
+EventLoop::EventLoop(void){
+    running = false;
+    stopping = false;
+
+    if(pipe(wake_fd) < 0){
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fd[1], F_SETFL, O_NONBLOCK);
+
+    for(int i = 0; i < EVENTLOOP_COMMAND_THREADS; i++)
+        workers.push_back(std::thread(&EventLoop::worker, this));
+}
+
+/*****************************************************************************/
+
+EventLoop::~EventLoop(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobs_cv.notify_all();
+    for(size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    ::close(wake_fd[0]);
+    ::close(wake_fd[1]);
+}
+
+/*****************************************************************************/
+
+void EventLoop::start(ScientISST &dev, BlockCallback on_block, DoneCallback on_done, int sample_rate,
+                      const ScientISST::Vint &channels, const char *file_name, bool simulated, int api){
+    const bool has_file = (file_name != NULL);
+    const std::string file(has_file ? file_name : "");
+
+    execute(dev, [=](ScientISST &d){
+        d.start(sample_rate, channels, has_file ? file.c_str() : NULL, simulated, api);
+        d.link->setReadSize(d.packet_size, d.packet_size);     //A read never waits for more than a packet, the loop serves other devices
+    }, [this, on_block, on_done](ScientISST &d, int error){
+        if(!error){
+            Device &e = device(d);
+            e.on_block = on_block;
+            e.acquiring = true;
+            e.buffer.resize(2*d.block.capacity*d.packet_size);     //Room for the largest block of blockDuration()
+            e.length = 0;
+            e.num_frames = 0;
+            e.last_data = std::chrono::steady_clock::now();
+        }
+        if(on_done)   on_done(d, error);
+    });
+}
+
+/*****************************************************************************/
+
+void EventLoop::stop(ScientISST &dev, DoneCallback on_done){
+    execute(dev, [](ScientISST &d){
+        d.stop();
+    }, on_done);
+}
+
+/*****************************************************************************/
+
+void EventLoop::state(ScientISST &dev, StateCallback on_done){
+    std::shared_ptr<ScientISST::State> st(new ScientISST::State());
+
+    execute(dev, [st](ScientISST &d){
+        *st = d.state();
+    }, [st, on_done](ScientISST &d, int error){
+        if(on_done)   on_done(d, error, *st);
+    });
+}
+
+/*****************************************************************************/
+
+void EventLoop::execute(ScientISST &dev, Command command, DoneCallback on_done){
+    ScientISST *d = &dev;
+
+    enqueue(device(dev), [this, d, command, on_done](){
+        int error = 0;
+        try{
+            command(*d);
+        }catch(ScientISST::Exception &e){
+            error = e.code;
+        }
+
+        post([this, d, on_done, error](){
+            Device &e = device(*d);
+            complete(e);
+            if(on_done)   on_done(*d, error);
+            dispatch(e);
+        });
+    });
+}
+
+/*****************************************************************************/
+
+void EventLoop::post(std::function<void()> fn){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        posted.push_back(fn);
+    }
+    wake();
+}
+
+/*****************************************************************************/
+
+void EventLoop::run(void){
+    running = true;
+    while(running)
+        runOnce();
+}
+
+/*****************************************************************************/
+
+void EventLoop::runOnce(int timeout_ms){
+    std::vector<pollfd> fds;
+    std::vector<Device*> polled;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    pollfd wake_pfd = {wake_fd[0], POLLIN, 0};
+    fds.push_back(wake_pfd);
+
+    for(std::map<ScientISST*, Device>::iterator it = devices.begin(); it != devices.end(); it++){
+        Device &d = it->second;
+        if(!d.acquiring || d.busy)   continue;
+
+        int left = EVENTLOOP_RECV_TIMEOUT_MS - std::chrono::duration_cast<std::chrono::milliseconds>(now - d.last_data).count();
+        if(left <= 0){
+            printf("recv: Error, a timeout occured\n");
+            METRIC_ADD(d.dev->metrics, TIMEOUTS, 1);
+            linkLost(d);
+            continue;
+        }
+        if(timeout_ms < 0 || left < timeout_ms)   timeout_ms = left;
+
+        pollfd pfd = {d.dev->link->handle(), POLLIN, 0};
+        fds.push_back(pfd);
+        polled.push_back(&d);
+    }
+
+    //A timeout of 0 still handles whatever is ready
+    if(poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR){
+        perror("poll");
+        return;
+    }
+
+    for(size_t i = 0; i < polled.size(); i++){
+        if(fds[i+1].revents & (POLLIN | POLLHUP | POLLERR))
+            receive(*polled[i]);
+    }
+
+    if(fds[0].revents & POLLIN){
+        char buff[64];
+        while(::read(wake_fd[0], buff, sizeof(buff)) > 0);
+    }
+
+    std::vector<std::function<void()> > ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(posted);
+    }
+    for(size_t i = 0; i < ready.size(); i++)
+        ready[i]();
+}
+
+/*****************************************************************************/
+
+void EventLoop::quit(void){
+    post([this](){
+        running = false;
+    });
+}
+
+/*****************************************************************************/
+
+EventLoop::Device& EventLoop::device(ScientISST &dev){
+    std::map<ScientISST*, Device>::iterator it = devices.find(&dev);
+    if(it != devices.end())   return it->second;
+
+    Device &d = devices[&dev];
+    d.dev = &dev;
+    d.busy = false;
+    d.acquiring = false;
+    d.length = 0;
+    d.num_frames = 0;
+    return d;
+}
+
+/*****************************************************************************/
+
+void EventLoop::enqueue(Device &d, std::function<void()> job){
+    d.commands.push_back(job);
+    dispatch(d);
+}
+
+/*****************************************************************************/
+
+// Hands the next command of the device to the command threads, unless one is already running.
+void EventLoop::dispatch(Device &d){
+    if(d.busy || d.commands.empty())   return;
+
+    d.busy = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(d.commands.front());
+    }
+    d.commands.pop_front();
+    jobs_cv.notify_one();
+}
+
+/*****************************************************************************/
+
+void EventLoop::complete(Device &d){
+    d.busy = false;
+    if(d.dev->num_chs == 0)   d.acquiring = false;
+}
+
+/*****************************************************************************/
+
+// Reads what the link has, decoding and handing over every block it completes.
+void EventLoop::receive(Device &d){
+    ScientISST &dev = *d.dev;
+
+    int ret = dev.link->recv(&d.buffer[d.length], d.buffer.size()-d.length, 0);
+    if(ret == 0)   return;     //Nothing after all
+    if(ret < 0){
+        printf("ScientISST did not send all bytes it was supposed to send\n");
+        linkLost(d);
+        return;
+    }
+    METRIC_ADD(dev.metrics, BYTES, ret);
+    if(dev.capture_file.isOpen())   dev.capture_file.write(&d.buffer[d.length], ret);
+    d.length += ret;
+    d.last_data = std::chrono::steady_clock::now();
+
+    const unsigned char *buffer = &d.buffer[0];
+    const unsigned char *end = buffer + d.length;
+    while(1){
+        d.num_frames += dev.decodePackets(buffer, end, d.num_frames);
+        if(d.num_frames < (int)dev.frames.size())   break;
+
+        const int num_frames = d.num_frames;
+        d.num_frames = 0;
+        dev.processBlock(num_frames);
+        if(d.on_block)   d.on_block(dev, num_frames);
+    }
+
+    d.length = end-buffer;
+    memmove(&d.buffer[0], buffer, d.length);
+}
+
+/*****************************************************************************/
+
+// In supervised mode the device is reconnected on a command thread and the frames decoded before the
+// loss are handed over as a short block, marked in the output file like ScientISST::read() does.
+void EventLoop::linkLost(Device &d){
+    ScientISST *dev = d.dev;
+
+    if(!dev->supervised){
+        d.acquiring = false;
+        if(d.on_block)   d.on_block(*dev, -ScientISST::Exception::CONTACTING_DEVICE);
+        return;
+    }
+
+    //Ahead of any queued command, which would fail on the lost link
+    d.commands.push_front([this, dev](){
+        bool restored;
+        try{
+            restored = dev->reconnect();
+        }catch(ScientISST::Exception &){
+            restored = false;
+        }
+
+        post([this, dev, restored](){
+            Device &e = device(*dev);
+            e.busy = false;
+            if(restored && dev->num_chs != 0){
+                const int num_frames = e.num_frames;
+                e.length = 0;
+                e.num_frames = 0;
+                e.last_data = std::chrono::steady_clock::now();
+                dev->processBlock(num_frames);
+                if(e.on_block)   e.on_block(*dev, num_frames);
+            }else{
+                e.acquiring = false;
+                if(e.on_block)   e.on_block(*dev, -ScientISST::Exception::CONTACTING_DEVICE);
+            }
+            dispatch(e);
+        });
+    });
+    dispatch(d);
+}
+
+/*****************************************************************************/
+
+void EventLoop::worker(void){
+    while(1){
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs_cv.wait(lock, [this](){ return stopping || !jobs.empty(); });
+            if(stopping)   return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+/*****************************************************************************/
+
+void EventLoop::wake(void){
+    char c = 0;
+    if(::write(wake_fd[1], &c, 1) < 0 && errno != EAGAIN)
+        perror("write");
+}
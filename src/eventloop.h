@@ -0,0 +1,110 @@
+#ifndef _EVENTLOOP_H
+#define _EVENTLOOP_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "scientisst.h"
+
+#define EVENTLOOP_COMMAND_THREADS   4       //Commands of different devices running at the same time
+#define EVENTLOOP_RECV_TIMEOUT_MS   RECV_TIMEOUT_MS     //Silence after which the link of an acquiring device is considered lost, as in ScientISST::recv()
+
+// Drives the acquisitions of many ScientISST devices from a single thread (Linux or Mac OS).
+// The links of the acquiring devices are polled together and their data is decoded as it arrives, so a
+// device never blocks the others. Commands (start, stop, state, ...) need the device's reply and the
+// 150 ms pause between commands, they run on a small pool of command threads and complete through a
+// callback. The commands of a device run one at a time, in the order they were given, and its link is not
+// polled while one is running. Every callback is called from the thread running the loop.
+class EventLoop
+{
+public:
+    /// Called with each block decoded during an acquisition, available in ScientISST::block and ScientISST::frames
+    /// until the callback returns. num_frames is what ScientISST::read() would have returned, or the negated
+    /// ScientISST::Exception::Code that ended the acquisition.
+    typedef std::function<void(ScientISST &dev, int num_frames)> BlockCallback;
+
+    /// Called when a command completes, error is 0 or the ScientISST::Exception::Code it threw.
+    typedef std::function<void(ScientISST &dev, int error)> DoneCallback;
+
+    /// Called when a state() command completes, state is only valid if error is 0.
+    typedef std::function<void(ScientISST &dev, int error, const ScientISST::State &state)> StateCallback;
+
+    /// A blocking ScientISST method call, run by execute() on a command thread.
+    typedef std::function<void(ScientISST &dev)> Command;
+
+    EventLoop(void);
+
+    /// Stops the command threads. Pending commands are dropped and acquisitions are left running.
+    ~EventLoop();
+
+    /** Starts an acquisition, with the arguments of ScientISST::start().
+        * \param[in] on_block Called with every block decoded until the acquisition is stopped or the link is lost.
+        * \param[in] on_done Called when the device is in live mode, or when starting failed.
+        */
+    void start(ScientISST &dev, BlockCallback on_block, DoneCallback on_done, int sample_rate = 1000,
+               const ScientISST::Vint &channels = ScientISST::Vint(), const char *file_name = "output.csv",
+               bool simulated = false, int api = API_MODE_SCIENTISST);
+
+    /// Stops an acquisition. Frames of an incomplete block are discarded.
+    void stop(ScientISST &dev, DoneCallback on_done);
+
+    /// Gets the device state.
+    void state(ScientISST &dev, StateCallback on_done);
+
+    /// Runs any other blocking method of the device (battery(), trigger(), dac(), ...) on a command thread.
+    void execute(ScientISST &dev, Command command, DoneCallback on_done);
+
+    /// Runs fn on the loop thread. This is the only method that is safe to call from other threads while
+    /// the loop is running, the others must be called from the loop thread (a callback) or before run().
+    void post(std::function<void()> fn);
+
+    /// Runs the loop until quit() is called.
+    void run(void);
+
+    /// Waits up to timeout_ms (forever if negative) for link data, completions or posted functions, and handles them.
+    void runOnce(int timeout_ms = -1);
+
+    /// Makes run() return. Can be called from any thread.
+    void quit(void);
+
+private:
+    struct Device
+    {
+        ScientISST *dev;
+        BlockCallback on_block;
+        std::deque<std::function<void()> > commands;   //Queued commands, the front one runs next on a command thread
+        bool busy;                                      //A command is running, the link is not polled
+        bool acquiring;
+        std::vector<unsigned char> buffer;              //Received bytes not decoded yet
+        int length;
+        int num_frames;                                 //Frames of the current block decoded so far
+        std::chrono::steady_clock::time_point last_data;
+    };
+
+    Device& device(ScientISST &dev);
+    void enqueue(Device &d, std::function<void()> job);
+    void dispatch(Device &d);
+    void complete(Device &d);
+    void receive(Device &d);
+    void linkLost(Device &d);
+    void worker(void);
+    void wake(void);
+
+    std::map<ScientISST*, Device> devices;  //Only used from the loop thread
+    bool running;
+
+    std::mutex mutex;                       //Guards posted, jobs and stopping
+    std::condition_variable jobs_cv;
+    std::vector<std::function<void()> > posted;
+    std::deque<std::function<void()> > jobs;
+    bool stopping;
+    std::vector<std::thread> workers;
+    int wake_fd[2];                         //Self-pipe waking the loop when a function is posted
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "group.h"
+
+void DeviceGroup::start(int sample_rate, const ScientISST::Vint &channels, bool simulated, int api){
+    std::vector<std::thread> threads;
+    std::vector<int> errors(devices.size(), 0);
+    int error = 0;
+
+    //Everything but the live mode commands, concurrently
+    for(size_t i = 0; i < devices.size(); i++){
+        threads.push_back(std::thread([&, i](){
+            try{
+                devices[i]->prepareStart(sample_rate, channels, simulated, api);
+            }catch(ScientISST::Exception &e){
+                errors[i] = e.code;
+            }
+        }));
+    }
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    for(size_t i = 0; i < devices.size() && !error; i++)
+        error = errors[i];
+    if(error){
+        //No live mode command was sent, every device is idle but those already in an acquisition of their own
+        for(size_t i = 0; i < devices.size(); i++){
+            if(errors[i] != ScientISST::Exception::DEVICE_NOT_IDLE)   devices[i]->num_chs = 0;
+        }
+        throw ScientISST::Exception((ScientISST::Exception::Code)error);
+    }
+
+    //Every device sent its last command during the setup, the pause before the first live mode command covers all of them
+    size_t live = 0;
+    start_times.assign(devices.size(), std::chrono::steady_clock::time_point());
+    try{
+        for(; live < devices.size(); live++){
+            devices[live]->goLive(live == 0);
+            start_times[live] = devices[live]->live_time;
+        }
+        for(size_t i = 0; i < devices.size(); i++)
+            devices[i]->openOutputs(NULL);
+    }catch(ScientISST::Exception&){
+        for(size_t i = live; i < devices.size(); i++)
+            devices[i]->num_chs = 0;
+        stopDevices(true);
+        throw;
+    }
+}
+
+/*****************************************************************************/
+
+void DeviceGroup::stop(void){
+    const int error = stopDevices(false);
+
+    if(error)   throw ScientISST::Exception((ScientISST::Exception::Code)error);
+}
+
+/*****************************************************************************/
+
+// Stops the devices concurrently, only those in acquisition if live_only. Returns the code of the first that failed, or 0.
+int DeviceGroup::stopDevices(bool live_only){
+    std::vector<std::thread> threads;
+    std::vector<int> errors(devices.size(), 0);
+
+    for(size_t i = 0; i < devices.size(); i++){
+        if(live_only && devices[i]->num_chs == 0)   continue;
+
+        threads.push_back(std::thread([&, i](){
+            try{
+                devices[i]->stop();
+            }catch(ScientISST::Exception &e){
+                errors[i] = e.code;
+            }
+        }));
+    }
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    for(size_t i = 0; i < devices.size(); i++){
+        if(errors[i])   return errors[i];
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+
+// Input of one device: its frames not read yet, with their timeline index.
+class Aligner::Stream : public Sink
+{
+public:
+    Stream(Aligner *_owner) : owner(_owner), head(0), len(0), running(false), has_origin(false) {}
+
+    virtual void open(const Block &layout);
+    virtual void write(const Block &b);
+    virtual void gap(int gap_ms, int missing_frames);
+
+    void reserve(int count);
+    bool begin(const Block &b, int n);
+
+    Aligner *owner;
+    Block frames;                   //Frames from head to len are not read yet
+    std::vector<int64_t> when;      //Timeline index of each frame
+    int head;
+    int len;
+    bool running;                   //The timeline index of the frames is known
+    int64_t next;                   //Timeline index of the next frame
+    int last_seq;                   //Sequence number of the previous frame, -1 if none
+    int last_bit;                   //Trigger input of the previous frame, -1 if none
+    bool has_origin;
+    std::chrono::steady_clock::time_point origin;
+};
+
+/*****************************************************************************/
+
+void Aligner::Stream::open(const Block &layout){
+    std::lock_guard<std::mutex> lock(owner->mutex);
+
+    //At least two blocks, so a block always fits after dropping the oldest frames
+    frames.resize(layout.num_chs, std::max(2*layout.capacity, (int)(layout.sample_rate*ALIGN_MAX_MS/1000)));
+    for(int i = 0; i < layout.num_chs; i++)
+        frames.chs[i] = layout.chs[i];
+    frames.sample_rate = layout.sample_rate;
+    when.assign(frames.capacity, 0);
+
+    head = len = 0;
+    running = false;
+    next = 0;
+    last_seq = last_bit = -1;
+}
+
+/*****************************************************************************/
+
+// Makes room for count frames, dropping the oldest ones if the other devices fell too far behind.
+void Aligner::Stream::reserve(int count){
+    if(len + count <= frames.capacity)   return;
+
+    head = std::max(head, len + count - frames.capacity);
+    frames.copy(0, frames, head, len-head);
+    memmove(&when[0], &when[head], (len-head)*sizeof(int64_t));
+    len -= head;
+    head = 0;
+}
+
+/*****************************************************************************/
+
+// Returns true if the timeline starts at frame n of b, and sets its index.
+bool Aligner::Stream::begin(const Block &b, int n){
+    if(owner->trigger_input){
+        const int bit = (b.digital[n] >> (owner->trigger_input == TRIGGER_I1 ? 3 : 2)) & 1;
+        const bool edge = last_bit == 0 && bit == 1;
+
+        last_bit = bit;
+        if(!edge)   return false;
+        next = 0;
+    }else{
+        const Stream *first = owner->streams[0];
+
+        next = 0;
+        if(has_origin && first->has_origin)
+            next = llround(std::chrono::duration<double>(origin - first->origin).count()*frames.sample_rate);
+    }
+
+    running = true;
+    return true;
+}
+
+/*****************************************************************************/
+
+void Aligner::Stream::write(const Block &b){
+    std::lock_guard<std::mutex> lock(owner->mutex);
+    int first = -1;     //First frame of b on the timeline
+
+    reserve(b.num_frames);
+
+    for(int n = 0; n < b.num_frames; n++){
+        //Frames dropped by the library, e.g. after a CRC failure
+        if(last_seq >= 0)   next += (b.seq[n] - last_seq - 1) & 0x0F;
+        last_seq = b.seq[n];
+
+        if(!running && !begin(b, n))   continue;
+        if(first < 0)   first = n;
+        when[len + n-first] = next++;
+    }
+
+    if(first >= 0){
+        frames.copy(len, b, first, b.num_frames-first);
+        len += b.num_frames-first;
+    }
+}
+
+/*****************************************************************************/
+
+void Aligner::Stream::gap(int gap_ms, int missing_frames){
+    std::lock_guard<std::mutex> lock(owner->mutex);
+
+    next += missing_frames;
+    last_seq = -1;      //Unrelated to the sequence numbers before the gap
+    last_bit = -1;
+}
+
+/*****************************************************************************/
+
+Aligner::Aligner(int num_devices) : trigger_input(0) {
+    for(int i = 0; i < num_devices; i++)
+        streams.push_back(new Stream(this));
+}
+
+/*****************************************************************************/
+
+Aligner::~Aligner(){
+    for(size_t i = 0; i < streams.size(); i++)
+        delete streams[i];
+}
+
+/*****************************************************************************/
+
+Sink* Aligner::input(int i){
+    if(i < 0 || i >= (int)streams.size())   throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+
+    return streams[i];
+}
+
+/*****************************************************************************/
+
+void Aligner::origin(int i, std::chrono::steady_clock::time_point t){
+    if(i < 0 || i >= (int)streams.size())   throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    streams[i]->origin = t;
+    streams[i]->has_origin = true;
+}
+
+/*****************************************************************************/
+
+int Aligner::read(std::vector<Block> &blocks, int64_t &first_frame){
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t t;
+    bool common;
+    int n;
+
+    if(streams.empty())   return 0;
+
+    //First instant all devices have, dropping the frames of the others before it
+    do{
+        t = INT64_MIN;
+        for(size_t i = 0; i < streams.size(); i++){
+            const Stream *s = streams[i];
+            if(s->head == s->len)   return 0;
+            t = std::max(t, s->when[s->head]);
+        }
+
+        common = true;
+        for(size_t i = 0; i < streams.size(); i++){
+            Stream *s = streams[i];
+            while(s->head < s->len && s->when[s->head] < t)
+                s->head++;
+            if(s->head == s->len || s->when[s->head] != t)   common = false;
+        }
+    }while(!common);
+
+    //Frames following it without a gap in any device
+    for(n = 1; ; n++){
+        bool all = true;
+        for(size_t i = 0; i < streams.size() && all; i++){
+            const Stream *s = streams[i];
+            all = s->head+n < s->len && s->when[s->head+n] == t+n;
+        }
+        if(!all)   break;
+    }
+
+    blocks.resize(streams.size());
+    for(size_t i = 0; i < streams.size(); i++){
+        Stream *s = streams[i];
+        Block &b = blocks[i];
+
+        if(b.num_chs != s->frames.num_chs || b.capacity < n)
+            b.resize(s->frames.num_chs, s->frames.capacity);
+        memcpy(b.chs, s->frames.chs, sizeof(b.chs));
+        b.sample_rate = s->frames.sample_rate;
+        b.copy(0, s->frames, s->head, n);
+        b.num_frames = n;
+        s->head += n;
+    }
+
+    first_frame = t;
+    return n;
+}
@@ -0,0 +1,81 @@
+#ifndef _GROUP_H
+#define _GROUP_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "scientisst.h"
+#include "trigger.h"
+
+#define ALIGN_MAX_MS    5000    //Frames an Aligner keeps per device while waiting for the others
+
+// Starts and stops several devices together. Setting up an acquisition takes a device several commands with
+// their pauses, so starting the devices one after the other makes them begin seconds apart. The group sets them
+// up concurrently and then sends their live mode commands back to back.
+class DeviceGroup
+{
+public:
+    /// Adds a device, which is not owned by the group.
+    void add(ScientISST *dev) { devices.push_back(dev); }
+
+    /** Starts an acquisition on every device, with the arguments of ScientISST::start() and no output file:
+        * the data goes to ScientISST::block and to the sinks of each device.
+        * If a device fails, the devices already started are stopped and its exception is thrown.
+        * \exception ScientISST::Exception (DEVICE_NOT_IDLE, INVALID_PARAMETER, CONTACTING_DEVICE)
+        */
+    void start(int sample_rate = 1000, const ScientISST::Vint &channels = ScientISST::Vint(),
+               bool simulated = false, int api = API_MODE_SCIENTISST);
+
+    /** Stops the acquisition of every device, concurrently. All devices are stopped even if one of them fails.
+        * \exception ScientISST::Exception (DEVICE_NOT_IN_ACQUISITION, CONTACTING_DEVICE) - of the first device that failed
+        */
+    void stop(void);
+
+    std::vector<ScientISST*> devices;
+    std::vector<std::chrono::steady_clock::time_point> start_times;    ///< Host time the live mode command of each device was sent
+
+private:
+    int stopDevices(bool live_only);
+};
+
+// Merges the streams of several devices acquiring at the same sample rate onto a common timeline.
+// Each device gets one of the input() sinks, which counts its frames, including those missing from the
+// sequence numbers and the link losses. The devices are aligned by the host times their acquisitions
+// started, given to origin(), or by an edge every device sees on a shared digital input, see alignOn().
+// The inputs can be written from different threads. Decimating filters must not be used, as they change
+// the step of the sequence numbers.
+class Aligner
+{
+public:
+    Aligner(int num_devices);
+    ~Aligner();
+
+    /// Sink to add to the i-th device with ScientISST::addSink().
+    Sink* input(int i);
+
+    /// Sets the host time the acquisition of the i-th device started, e.g. DeviceGroup::start_times[i].
+    /// Must be called before its first block. Without it, the frames are aligned by their count only.
+    void origin(int i, std::chrono::steady_clock::time_point t);
+
+    /// Aligns the devices on the first rising edge of a digital input (TRIGGER_I1 or TRIGGER_I2) wired to
+    /// all of them, e.g. an output set with ScientISST::trigger(). Frames before it are discarded. 0 uses the origins.
+    void alignOn(int digital_input) { trigger_input = digital_input; }
+
+    /** Moves the next frames that every device has for the same instants to blocks, one Block per device.
+        * The blocks are only reallocated if they are too small.
+        * \param[out] first_frame Timeline index of the first frame, in frames since the origin of the first
+        * device or since the trigger edge
+        * \return Number of frames in each block, 0 if a device has no frame for the next instant yet
+        */
+    int read(std::vector<Block> &blocks, int64_t &first_frame);
+
+private:
+    class Stream;
+
+    std::vector<Stream*> streams;
+    int trigger_input;
+    std::mutex mutex;   //Guards the streams
+};
+
+#endif
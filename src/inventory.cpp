@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "inventory.h"
+
+/*****************************************************************************/
+
+Inventory& Inventory::instance(void){
+    static Inventory inventory;     //Thread-safe initialization since C++11
+    return inventory;
+}
+
+/*****************************************************************************/
+
+Inventory::Inventory(void){
+    const char *env = getenv(INVENTORY_ENV);
+    const char *home = getenv("HOME");
+
+    if(env != NULL){
+        path = env;
+    }else if(home != NULL){
+        path = std::string(home) + "/" + INVENTORY_FILENAME;
+    }else{
+        path = INVENTORY_FILENAME;
+    }
+
+    load();
+}
+
+/*****************************************************************************/
+
+bool Inventory::lookup(const std::string &key, Entry &entry){
+    std::lock_guard<std::mutex> guard(lock);
+
+    for(size_t i = 0; i < devs.size(); i++){
+        if(strcasecmp(devs[i].macAddr.c_str(), key.c_str()) == 0 || devs[i].name == key){
+            entry = devs[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/*****************************************************************************/
+
+void Inventory::update(const Entry &entry){
+    std::lock_guard<std::mutex> guard(lock);
+
+    int i = find(entry.macAddr);
+    if(i < 0){
+        devs.push_back(entry);
+        i = devs.size()-1;
+    }else{
+        devs[i] = entry;
+    }
+    devs[i].lastSeen = time(NULL);
+
+    save();
+}
+
+/*****************************************************************************/
+
+Inventory::VEntry Inventory::entries(void){
+    std::lock_guard<std::mutex> guard(lock);
+    return devs;
+}
+
+/*****************************************************************************/
+
+int Inventory::find(const std::string &mac_addr){
+    for(size_t i = 0; i < devs.size(); i++){
+        if(strcasecmp(devs[i].macAddr.c_str(), mac_addr.c_str()) == 0)    return i;
+    }
+    return -1;
+}
+
+/*****************************************************************************/
+
+// One device per line, tab separated:
+// mac  name  firmware  has_adc_chars adc_num atten bit_width coeff_a coeff_b vref  last_seen
+void Inventory::load(void){
+    char line[1024];
+    FILE *fd = fopen(path.c_str(), "r");
+
+    if(fd == NULL)   return;    //No inventory yet
+
+    while(fgets(line, sizeof(line), fd) != NULL){
+        char *fields[5];
+        int num_fields = 0;
+        char *p = line;
+        Entry entry;
+        unsigned int has_chars, adc_num, atten, bit_width;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] == '#' || line[0] == '\0')   continue;
+
+        while(num_fields < 5){
+            fields[num_fields++] = p;
+            p = strchr(p, '\t');
+            if(p == NULL)   break;
+            *p++ = '\0';
+        }
+        if(num_fields != 5){
+            printf("Inventory: ignoring malformed line in %s\n", path.c_str());
+            continue;
+        }
+
+        entry.macAddr = fields[0];
+        entry.name = fields[1];
+        entry.firmware = fields[2];
+        if(sscanf(fields[3], "%u %u %u %u %u %u %u", &has_chars, &adc_num, &atten, &bit_width,
+                  &entry.adcChars.coeff_a, &entry.adcChars.coeff_b, &entry.adcChars.vref) == 7){
+            entry.hasAdcChars = has_chars;
+            entry.adcChars.adc_num = (adc_unit_t)adc_num;
+            entry.adcChars.atten = (adc_atten_t)atten;
+            entry.adcChars.bit_width = (adc_bits_width_t)bit_width;
+        }
+        entry.lastSeen = atol(fields[4]);
+
+        devs.push_back(entry);
+    }
+
+    fclose(fd);
+}
+
+/*****************************************************************************/
+
+// Written to a temporary file first, so a crash never leaves a truncated inventory behind
+void Inventory::save(void){
+    std::string tmp_path = path + ".tmp";
+    FILE *fd = fopen(tmp_path.c_str(), "w");
+
+    if(fd == NULL){
+        printf("Inventory: cannot write %s\n", tmp_path.c_str());
+        return;
+    }
+
+    fprintf(fd, "# ScientISST device inventory\n");
+    for(size_t i = 0; i < devs.size(); i++){
+        const Entry &e = devs[i];
+        fprintf(fd, "%s\t%s\t%s\t%d %u %u %u %u %u %u\t%ld\n", e.macAddr.c_str(), e.name.c_str(), e.firmware.c_str(),
+                e.hasAdcChars, e.adcChars.adc_num, e.adcChars.atten, e.adcChars.bit_width,
+                e.adcChars.coeff_a, e.adcChars.coeff_b, e.adcChars.vref, e.lastSeen);
+    }
+
+    if(fclose(fd) != 0 || rename(tmp_path.c_str(), path.c_str()) != 0){
+        printf("Inventory: cannot write %s\n", path.c_str());
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef _INVENTORY_H
+#define _INVENTORY_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include "esp_adc.h"
+
+#define INVENTORY_FILENAME  ".scientisst_devices"    //Created in $HOME, or where $SCIENTISST_INVENTORY points to
+#define INVENTORY_ENV       "SCIENTISST_INVENTORY"
+
+// Persistent cache of the devices seen by discovery or by a connection, shared by all ScientISST objects of a process.
+// Every update is written through to disk so other processes (and the next session) start from the same inventory.
+class Inventory
+{
+public:
+    /// A known device.
+    struct Entry
+    {
+        std::string macAddr;        ///< Key of the device: Bluetooth MAC address, or the address used to connect to it
+        std::string name;           ///< Bluetooth name, empty if never discovered
+        std::string firmware;       ///< Firmware version string, empty if never connected
+        bool hasAdcChars;           ///< True if adcChars holds the characteristics reported by the device
+        esp_adc_cal_characteristics_t adcChars;     ///< ADC characteristics, without the lookup table pointers
+        long lastSeen;              ///< Unix time of the last discovery or connection
+
+        Entry() : hasAdcChars(false), adcChars(), lastSeen(0) {}
+    };
+    typedef std::vector<Entry> VEntry;
+
+    /// Returns the process-wide inventory, loading it from disk on first use.
+    static Inventory& instance(void);
+
+    /** Looks up a device.
+        * \param[in] key MAC address (case insensitive) or name of the device
+        * \param[out] entry Copy of the device entry, if found
+        * \return true if the device is known
+        */
+    bool lookup(const std::string &key, Entry &entry);
+
+    /// Adds or replaces the entry with the same macAddr and saves the inventory.
+    void update(const Entry &entry);
+
+    /// Returns a copy of all known devices.
+    VEntry entries(void);
+
+private:
+    Inventory(void);
+    void load(void);
+    void save(void);
+    int find(const std::string &mac_addr);
+
+    std::string path;
+    VEntry devs;
+    std::mutex lock;
+};
+
+#endif
@@ -56,6 +56,8 @@ int main(int argc, char **argv){
         return 0;
         */
 
+        //ScientISST::serveMetrics("127.0.0.1:9100");  // expose acquisition metrics to Prometheus (optional)
+
         printf("Connecting to device - %s\n", argv[1]);
 
         ScientISST dev(argv[1]); // connect to device provided
@@ -71,17 +73,33 @@ int main(int argc, char **argv){
         //ScientISST dev("COM5");  // Bluetooth virtual COM port or USB-UART COM port (Windows)
 
         //ScientISST dev("/dev/ttyUSB0");  // USB-UART device (Linux)
+        //ScientISST dev("/dev/ttyUSB0:921600");  // USB-UART device at 921600 baud, 115200 if no rate is given (Linux)
         //ScientISST dev("/dev/rfcomm0");  // Bluetooth virtual serial port (Linux)
 
         //ScientISST dev("/dev/tty.usbserial-A1000QIz");  // USB-UART device (Mac OS)
         //ScientISST dev("/dev/tty.scientisst-DevB");  // Bluetooth virtual serial port (Mac OS)
 
+        //ScientISST dev("replay:capture.raw@max");  // play back a capture as fast as it is decoded (Linux or Mac OS)
+
         puts("Connected to device. Press Enter to exit.");
 
         //dev.battery(10);  // set battery threshold (optional)
 
+        //dev.supervise();  // reconnect and resume the acquisition if the Bluetooth link drops (optional)
+
+        //DspConfig dsp;  // remove mains interference and decimate to a quarter of the sample rate (optional)
+        //dsp.notch_hz = 50;
+        //dsp.decimation = 4;
+        //dev.filter(dsp);
+
         //dev.trigger({true, false});                // To trigger digital outputs
 
+        //BinarySink binary("output.bin");  // also write the data in binary, pass NULL as the file name to skip the CSV (optional)
+        //dev.addSink(&binary);
+
+        //dev.capture("capture.raw");  // record the raw bytes received, to replay the session later (optional)
+        //dev.blockDuration(10);  // each read() returns about 10 ms of frames, for closed-loop feedback (optional)
+
         dev.start(16000, {AI2}, argv[2], false, API_MODE_SCIENTISST);
 
         std::chrono::steady_clock::time_point time_last_printed = std::chrono::steady_clock::now();
@@ -92,6 +110,14 @@ int main(int argc, char **argv){
             if(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_last_printed).count() >= 200){
                 const ScientISST::Frame &f = dev.frames[0];   // get a reference to the first frame of each frames block
                 dev.writeFrameFile(stdout, f);
+
+                // uncomment this block to also print the signal quality of each channel
+                /*
+                ScientISST::VChannelStats st = dev.stats();
+                for(size_t i = 0; i < st.size(); i++)
+                    printf("ch%d: mean %.1f, rms %.1f, saturated %lu%s\n", st[i].channel, st[i].mean, st[i].rms,
+                           (unsigned long)st[i].saturated, st[i].flatline ? ", flatline" : "");
+                */
                 time_last_printed = std::chrono::steady_clock::now();
             }
 
@@ -0,0 +1,251 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "metrics.h"
+
+#define METRICS_MIN_LE_EXP  10      //Exported bucket bounds go from 2^10 ns (~1 us)...
+#define METRICS_MAX_LE_EXP  34      //...to 2^34 ns (~17 s)
+
+static const char* counter_names[Metrics::NUM_COUNTERS] = {
+    "scientisst_received_bytes_total",
+    "scientisst_frames_total",
+    "scientisst_crc_failures_total",
+    "scientisst_resyncs_total",
+    "scientisst_timeouts_total",
+    "scientisst_reconnects_total",
+};
+
+static const char* timer_names[Metrics::NUM_TIMERS] = {
+    "scientisst_recv_seconds",
+    "scientisst_crc_seconds",
+    "scientisst_decode_seconds",
+    "scientisst_convert_seconds",
+    "scientisst_filter_seconds",
+    "scientisst_write_seconds",
+};
+
+//All live Metrics instances, exported by the endpoint
+static std::mutex registry_lock;
+static std::vector<Metrics*> registry;
+
+/*****************************************************************************/
+
+Histogram::Histogram(void){
+    for(int i = 0; i < METRICS_NUM_BUCKETS; i++)   buckets[i] = 0;
+    sum = 0;
+    count = 0;
+}
+
+/*****************************************************************************/
+
+// Values below 2^(SUB_BUCKETS_BITS+1) have a bucket each, above that each power of two is split
+// in 2^SUB_BUCKETS_BITS linear sub-buckets
+int Histogram::bucket(uint64_t ns){
+    const int linear = 1 << (METRICS_SUB_BUCKETS_BITS+1);
+
+    if(ns < (uint64_t)linear)   return ns;
+
+    const int e = 63-__builtin_clzll(ns);
+    if(e >= METRICS_MAX_EXP)   return METRICS_NUM_BUCKETS-1;
+
+    const int sub = (ns >> (e-METRICS_SUB_BUCKETS_BITS)) & ((1 << METRICS_SUB_BUCKETS_BITS)-1);
+    return linear + (e-METRICS_SUB_BUCKETS_BITS-1)*(1 << METRICS_SUB_BUCKETS_BITS) + sub;
+}
+
+/*****************************************************************************/
+
+void Histogram::record(uint64_t ns){
+    buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*****************************************************************************/
+
+// Exported with power of two bounds only, which fall on sub-bucket boundaries
+void Histogram::print(std::string &out, const char *name, const std::string &labels) const{
+    char line[256];
+    uint64_t cumulative = 0;
+    int b = 0;
+
+    for(int e = METRICS_MIN_LE_EXP; e <= METRICS_MAX_LE_EXP; e++){
+        const int end = bucket(1ULL << e);
+        for(; b < end; b++)   cumulative += buckets[b].load(std::memory_order_relaxed);
+
+        snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%.9g\"} %llu\n", name, labels.c_str(), (double)(1ULL << e)*1e-9, (unsigned long long)cumulative);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels.c_str(), (unsigned long long)count.load());
+    out += line;
+    snprintf(line, sizeof(line), "%s_sum{%s} %.9f\n", name, labels.c_str(), sum.load()*1e-9);
+    out += line;
+    snprintf(line, sizeof(line), "%s_count{%s} %llu\n", name, labels.c_str(), (unsigned long long)count.load());
+    out += line;
+}
+
+/*****************************************************************************/
+
+Metrics::Metrics(void){
+    for(int i = 0; i < NUM_COUNTERS; i++)   counters[i] = 0;
+    label("");
+
+    std::lock_guard<std::mutex> guard(registry_lock);
+    registry.push_back(this);
+}
+
+/*****************************************************************************/
+
+Metrics::~Metrics(void){
+    std::lock_guard<std::mutex> guard(registry_lock);
+    registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+}
+
+/*****************************************************************************/
+
+void Metrics::label(const std::string &device){
+    std::lock_guard<std::mutex> guard(registry_lock);
+    labels = "device=\"" + device + "\"";
+}
+
+/*****************************************************************************/
+
+// Each metric family is printed once, with a sample per device
+void Metrics::printAll(std::string &out){
+    std::lock_guard<std::mutex> guard(registry_lock);
+    char line[256];
+
+    for(int i = 0; i < NUM_COUNTERS; i++){
+        out += std::string("# TYPE ") + counter_names[i] + " counter\n";
+        for(size_t d = 0; d < registry.size(); d++){
+            snprintf(line, sizeof(line), "%s{%s} %llu\n", counter_names[i], registry[d]->labels.c_str(),
+                     (unsigned long long)registry[d]->counters[i].load(std::memory_order_relaxed));
+            out += line;
+        }
+    }
+    for(int i = 0; i < NUM_TIMERS; i++){
+        out += std::string("# TYPE ") + timer_names[i] + " histogram\n";
+        for(size_t d = 0; d < registry.size(); d++){
+            registry[d]->timers[i].print(out, timer_names[i], registry[d]->labels);
+        }
+    }
+}
+
+/*****************************************************************************/
+
+uint64_t Metrics::now(void){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*****************************************************************************/
+
+static void metricsServer(int listen_fd){
+    char request[1024];
+    int retry_ms = METRICS_ACCEPT_RETRY_MS;
+
+    while(1){
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if(client_fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED)   continue;
+
+            //E.g. out of file descriptors, retrying at once would only spin
+            std::this_thread::sleep_for(std::chrono::milliseconds(retry_ms));
+            retry_ms = std::min(2*retry_ms, METRICS_ACCEPT_MAX_RETRY_MS);
+            continue;
+        }
+        retry_ms = METRICS_ACCEPT_RETRY_MS;
+
+        //Clients are served one at a time, a stalled one must not hold the others back
+        struct timeval timeout;
+        timeout.tv_sec = METRICS_CLIENT_TIMEOUT_MS/1000;
+        timeout.tv_usec = (METRICS_CLIENT_TIMEOUT_MS%1000)*1000;
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        //The request is read but not parsed, every path returns the metrics
+        if(::recv(client_fd, request, sizeof(request), 0) < 0){
+            close(client_fd);
+            continue;
+        }
+
+        std::string body;
+        Metrics::printAll(body);
+
+        char header[256];
+        snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", body.size());
+        std::string response = header + body;
+
+        size_t sent = 0;
+        while(sent < response.size()){
+            ssize_t ret = ::send(client_fd, response.data()+sent, response.size()-sent, MSG_NOSIGNAL);
+            if(ret <= 0)   break;
+            sent += ret;
+        }
+        close(client_fd);
+    }
+}
+
+/*****************************************************************************/
+
+bool serveMetrics(const char *address){
+    int listen_fd;
+
+    if(memcmp(address, "unix:", 5) == 0){
+        struct sockaddr_un local_addr;
+
+        memset(&local_addr, 0, sizeof(local_addr));
+        local_addr.sun_family = AF_UNIX;
+        strncpy(local_addr.sun_path, address+5, sizeof(local_addr.sun_path)-1);
+        unlink(local_addr.sun_path);    //Left behind by a previous run
+
+        if((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0){
+            perror("socket: ");
+            return false;
+        }
+        if(bind(listen_fd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0){
+            perror("bind: ");
+            close(listen_fd);
+            return false;
+        }
+    }else{
+        struct sockaddr_in local_addr;
+        const char *port_str = strrchr(address, ':');
+        int opt = 1;
+
+        memset(&local_addr, 0, sizeof(local_addr));
+        local_addr.sin_family = AF_INET;
+        local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);     //Never exposed outside the host
+        local_addr.sin_port = htons(atoi(port_str != NULL ? port_str+1 : address));
+
+        if((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0){
+            perror("socket: ");
+            return false;
+        }
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if(bind(listen_fd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0){
+            perror("bind: ");
+            close(listen_fd);
+            return false;
+        }
+    }
+
+    if(listen(listen_fd, METRICS_BACKLOG) < 0){
+        perror("listen: ");
+        close(listen_fd);
+        return false;
+    }
+
+    std::thread(metricsServer, listen_fd).detach();
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Instrumentation of the acquisition hot path. Build with -DHASMETRICS to enable it, otherwise
+// the METRIC_* macros expand to nothing and no clock is read.
+#ifdef HASMETRICS
+#define METRIC_ADD(m, counter, n)   (m).add(Metrics::counter, n)
+#define METRIC_START(t)             uint64_t t = Metrics::now()
+#define METRIC_STOP(m, timer, t)    (m).record(Metrics::timer, Metrics::now()-(t))
+#else
+#define METRIC_ADD(m, counter, n)
+#define METRIC_START(t)
+#define METRIC_STOP(m, timer, t)
+#endif
+
+#define METRICS_SUB_BUCKETS_BITS    3       //8 linear sub-buckets per power of two, <12.5% relative error
+#define METRICS_MAX_EXP             40      //Longest measurable time is 2^40 ns (~18 minutes)
+#define METRICS_NUM_BUCKETS         ((1 << (METRICS_SUB_BUCKETS_BITS+1)) + (METRICS_MAX_EXP-METRICS_SUB_BUCKETS_BITS)*(1 << METRICS_SUB_BUCKETS_BITS))
+#define METRICS_BACKLOG             4
+#define METRICS_CLIENT_TIMEOUT_MS   1000    //A client that doesn't send its request or read the response in time is dropped
+#define METRICS_ACCEPT_RETRY_MS     100     //First wait after a failed accept, doubled up to METRICS_ACCEPT_MAX_RETRY_MS
+#define METRICS_ACCEPT_MAX_RETRY_MS 5000
+
+// Lock-free log-linear (HDR style) histogram of durations in ns.
+class Histogram
+{
+public:
+    Histogram(void);
+    void record(uint64_t ns);
+    void print(std::string &out, const char *name, const std::string &labels) const;
+
+private:
+    static int bucket(uint64_t ns);
+
+    std::atomic<uint64_t> buckets[METRICS_NUM_BUCKETS];
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> count;
+};
+
+// Counters and latency histograms of one device. Every instance registers itself, so the metrics
+// endpoint started with serveMetrics() exports all devices of the process.
+class Metrics
+{
+public:
+    enum Counter
+    {
+        BYTES,          ///< Bytes received from the device
+        FRAMES,         ///< Frames decoded
+        CRC_FAILURES,   ///< Frames that failed the CRC check
+        RESYNCS,        ///< Times the stream was resynchronized after a CRC failure
+        TIMEOUTS,       ///< Receive timeouts
+        RECONNECTS,     ///< Successful reconnects after a lost link
+        NUM_COUNTERS
+    };
+
+    enum Timer
+    {
+        RECV,           ///< Waiting for and reading a block from the link
+        CRC,            ///< CRC checks of a block
+        DECODE,         ///< Unpacking the frames of a block, CRC included
+        CONVERT,        ///< Conversion of a block to mV
+        FILTER,         ///< Streaming filters of a block
+        WRITE,          ///< Writing a block to the output
+        NUM_TIMERS
+    };
+
+    Metrics(void);
+    ~Metrics(void);
+
+    /// Sets the value of the device label of the exported metrics.
+    void label(const std::string &device);
+
+    void add(Counter c, uint64_t n) { counters[c].fetch_add(n, std::memory_order_relaxed); }
+    void record(Timer t, uint64_t ns) { timers[t].record(ns); }
+
+    /// Appends the metrics of all devices in the Prometheus text exposition format.
+    static void printAll(std::string &out);
+
+    /// Monotonic time in ns.
+    static uint64_t now(void);
+
+private:
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+
+    std::string labels;
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+    Histogram timers[NUM_TIMERS];
+};
+
+/** Starts serving the metrics of all devices over HTTP, from a background thread.
+    * \param[in] address A Unix socket path ("unix:/path") or a loopback TCP port ("127.0.0.1:9100" or "9100")
+    * \return false if the socket could not be opened
+    */
+bool serveMetrics(const char *address);
+
+#endif
@@ -0,0 +1,108 @@
+#include "packet.h"
+#include "scientisst.h"
+
+static const unsigned char CRC4tab[16] = {0, 3, 6, 5, 12, 15, 10, 9, 11, 8, 13, 14, 7, 4, 1, 2};
+
+bool checkCRC4(const unsigned char *data, int len)
+{
+   unsigned char crc = 0;
+
+   for (int i = 0; i < len-1; i++)
+   {
+      const unsigned char b = data[i];
+      crc = CRC4tab[crc] ^ (b >> 4);
+      crc = CRC4tab[crc] ^ (b & 0x0F);
+   }
+
+   // CRC for last byte
+   crc = CRC4tab[crc] ^ (data[len-1] >> 4);
+   crc = CRC4tab[crc];
+
+   return (crc == (data[len-1] & 0x0F));
+}
+
+/*****************************************************************************/
+
+int packetSize(const int *chs, int num_chs){
+    int num_intern_active_chs = 0;
+    int num_extern_active_chs = 0;
+
+    for(int i = 0; i < num_chs; i++){
+        if(chs[i] == AX1 || chs[i] == AX2){
+            num_extern_active_chs++;
+        }else{
+            num_intern_active_chs++;
+        }
+    }
+
+    //Add 24bit channel's contributuion to packet size
+    int size = 3*num_extern_active_chs;
+
+    //Add 12bit channel's contributuion to packet size
+    if(!(num_intern_active_chs % 2)){                    //If it's an even number
+        size += ((num_intern_active_chs*12)/8);
+    }else{
+        size += (((num_intern_active_chs*12)-4)/8); //-4 because 4 bits can go in the I/0 byte
+    }
+    return size + 2;  //for the I/Os and seq+crc bytes
+}
+
+/*****************************************************************************/
+
+void decodePacket(const unsigned char *buffer, int packet_size, const int *chs, int num_chs,
+                  uint8_t &seq, uint8_t &digital, int32_t *raw, int stride){
+    int mid_frame_flag = 0;
+    int byte_it = 0;
+
+    //Get seq number and IO states
+    seq = buffer[packet_size-1] >> 4;
+    digital = buffer[packet_size-2] >> 4;
+
+    //Get channel values
+    for(int i = num_chs-1; i >= 0; i--){
+        const int curr_ch = chs[i];
+
+        //If it's an AX channel
+        if(curr_ch == AX1 || curr_ch == AX2){
+            raw[i*stride] = *(uint32_t*)(buffer+byte_it) & 0xFFFFFF;
+            byte_it += 3;
+
+        //If it's an AI channel
+        }else{
+            if(!mid_frame_flag){
+                raw[i*stride] = *(uint16_t*)(buffer+byte_it) & 0xFFF;
+                byte_it++;
+                mid_frame_flag = 1;
+            }else{
+                raw[i*stride] = *(uint16_t*)(buffer+byte_it) >> 4;
+                byte_it += 2;
+                mid_frame_flag = 0;
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+
+int32_t rawToValue(int ch, uint32_t raw, const esp_adc_cal_characteristics_t *chars){
+    if(ch == AX1 || ch == AX2){
+        int32_t aux;
+        aux = (int32_t)raw << 8;
+        aux = aux >> 8;
+        return aux;
+    }
+    return esp_adc_cal_raw_to_voltage(raw, chars)*VOLT_DIVIDER_FACTOR;
+}
+
+/*****************************************************************************/
+
+void initAdcLut(esp_adc_cal_characteristics_t *chars)
+{
+    if (LUT_ENABLED && chars->atten == ADC_ATTEN_DB_11) {
+        chars->low_curve = (chars->adc_num == ADC_UNIT_1) ? lut_adc1_low : lut_adc2_low;
+        chars->high_curve = (chars->adc_num == ADC_UNIT_1) ? lut_adc1_high : lut_adc2_high;
+    } else {
+        chars->low_curve = NULL;
+        chars->high_curve = NULL;
+    }
+}
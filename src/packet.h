@@ -0,0 +1,34 @@
+#ifndef _PACKET_H
+#define _PACKET_H
+
+#include <cstdint>
+#include "esp_adc.h"
+
+#define VOLT_DIVIDER_FACTOR 3.399           //Input voltage divider of the AI channels
+
+// Packets of the binary API (API_MODE_SCIENTISST), decoded by ScientISST while acquiring and by BulkDecoder offline.
+// A packet holds the values of the channels, the last channel first, AX channels in 24 bits and AI channels
+// in 12 bits, then the digital ports in the high nibble of the next to last byte, and the sequence number
+// and the CRC4 of the packet in the last byte.
+
+/// True if the CRC4 in the last byte of the packet of len bytes at data is valid.
+bool checkCRC4(const unsigned char *data, int len);
+
+/// Bytes of a packet with the channels chs (AI1...AX2).
+int packetSize(const int *chs, int num_chs);
+
+/** Decodes the packet at buffer.
+    * \param[out] seq Sequence number (0...15)
+    * \param[out] digital Digital ports I1 I2 O1 O2 as bits 3...0
+    * \param[out] raw Raw value of each channel, in the order of chs, stride values apart
+    */
+void decodePacket(const unsigned char *buffer, int packet_size, const int *chs, int num_chs,
+                  uint8_t &seq, uint8_t &digital, int32_t *raw, int stride);
+
+/// Converts a raw value to mV for AI channels, or sign extends it for the 24 bit AX channels.
+int32_t rawToValue(int ch, uint32_t raw, const esp_adc_cal_characteristics_t *chars);
+
+/// Initializes the lookup table fields of the adc characteristics, if the attenuation needs them.
+void initAdcLut(esp_adc_cal_characteristics_t *chars);
+
+#endif
@@ -0,0 +1,265 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include "replay.h"
+#include "scientisst.h"
+
+#ifndef MSG_NOSIGNAL    //Mac OS
+#define MSG_NOSIGNAL 0
+#endif
+
+bool CaptureWriter::open(const char *file_name, const CaptureHeader &header){
+    const uint32_t fields[6] = {REPLAY_MAGIC, REPLAY_VERSION, header.api_mode, header.sr_cmd, header.live_cmd,
+                                (uint32_t)header.firmware_version.size()};
+    std::vector<uint8_t> bytes((const uint8_t*)fields, (const uint8_t*)fields + sizeof(fields));
+
+    bytes.insert(bytes.end(), header.firmware_version.begin(), header.firmware_version.end());
+    bytes.insert(bytes.end(), (const uint8_t*)&header.adc_chars, (const uint8_t*)&header.adc_chars + 6*sizeof(uint32_t));
+
+    if(!file.open(file_name))   return false;
+    file.header(&bytes[0], bytes.size());
+
+    start = std::chrono::steady_clock::now();
+    return true;
+}
+
+/*****************************************************************************/
+
+void CaptureWriter::write(const void *data, int len){
+    const int64_t t_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    const uint32_t size = len;
+
+    file.write(&t_us, sizeof(t_us));
+    file.write(&size, sizeof(size));
+    file.write(data, len);
+}
+
+/*****************************************************************************/
+
+void CaptureWriter::close(void){
+    file.close();
+}
+
+/*****************************************************************************/
+
+bool Replay::open(const char *file_name, double _speed, int _fd){
+    close();
+
+    file = fopen(file_name, "rb");
+    if(file == NULL){
+        perror(file_name);
+        return false;
+    }
+    if(!readHeader()){
+        printf("%s is not a ScientISST capture\n", file_name);
+        fclose(file);
+        return false;
+    }
+    data_offset = ftell(file);
+
+    fd = _fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);    //Commands are read while the stream waits for the reader
+
+    speed = _speed;
+    streaming = false;
+    chunk.clear();
+    chunk_sent = 0;
+    quit = false;
+    thread = std::thread(&Replay::run, this);
+
+    return true;
+}
+
+/*****************************************************************************/
+
+void Replay::close(void){
+    if(fd < 0)   return;
+
+    quit = true;
+    thread.join();
+
+    fd = -1;
+    fclose(file);
+}
+
+/*****************************************************************************/
+
+static bool readCaptureHeader(FILE *file, CaptureHeader &header){
+    uint32_t fields[6];
+
+    if(fread(fields, sizeof(fields), 1, file) != 1)   return false;
+    if(fields[0] != REPLAY_MAGIC || fields[1] != REPLAY_VERSION || fields[5] > 1024)   return false;
+
+    header.api_mode = fields[2];
+    header.sr_cmd = fields[3];
+    header.live_cmd = fields[4];
+
+    header.firmware_version.resize(fields[5]);
+    if(fields[5] > 0 && fread(&header.firmware_version[0], fields[5], 1, file) != 1)   return false;
+
+    memset(&header.adc_chars, 0, sizeof(header.adc_chars));
+    return fread(&header.adc_chars, 6*sizeof(uint32_t), 1, file) == 1;
+}
+
+/*****************************************************************************/
+
+bool readCapture(const char *file_name, CaptureHeader &header, std::vector<uint8_t> &data){
+    FILE *file = fopen(file_name, "rb");
+    if(file == NULL){
+        perror(file_name);
+        return false;
+    }
+    if(!readCaptureHeader(file, header)){
+        printf("%s is not a ScientISST capture\n", file_name);
+        fclose(file);
+        return false;
+    }
+
+    //The chunks are appended as they are, a truncated last chunk is dropped
+    const long data_offset = ftell(file);
+    fseek(file, 0, SEEK_END);
+    data.clear();
+    data.reserve(ftell(file) - data_offset);
+    fseek(file, data_offset, SEEK_SET);
+
+    int64_t t_us;
+    uint32_t size;
+    while(fread(&t_us, sizeof(t_us), 1, file) == 1 && fread(&size, sizeof(size), 1, file) == 1 && size <= REPLAY_MAX_CHUNK){
+        const size_t at = data.size();
+        data.resize(at + size);
+        if(size > 0 && fread(&data[at], size, 1, file) != 1){
+            data.resize(at);
+            break;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+/*****************************************************************************/
+
+bool Replay::readHeader(void){
+    return readCaptureHeader(file, header);
+}
+
+/*****************************************************************************/
+
+// Reads the next chunk of the capture, returns false at its end.
+bool Replay::nextChunk(void){
+    uint32_t size;
+
+    if(fread(&chunk_time_us, sizeof(chunk_time_us), 1, file) != 1 || fread(&size, sizeof(size), 1, file) != 1)
+        return false;
+    if(size > REPLAY_MAX_CHUNK){
+        printf("Replay: damaged capture, stopping\n");
+        return false;
+    }
+
+    chunk.resize(size);
+    chunk_sent = 0;
+    return size == 0 || fread(&chunk[0], size, 1, file) == 1;
+}
+
+/*****************************************************************************/
+
+// Acts on a command of the host, as the device would for the commands that matter to a replay.
+void Replay::command(const uint8_t *cmd){
+    if(cmd[0] == 0x07){     //Version string and adc characteristics
+        std::vector<uint8_t> reply(header.firmware_version.begin(), header.firmware_version.end());
+        reply.push_back('\0');
+        reply.insert(reply.end(), (const uint8_t*)&header.adc_chars, (const uint8_t*)&header.adc_chars + 6*sizeof(uint32_t));
+
+        if(::send(fd, &reply[0], reply.size(), MSG_NOSIGNAL) != (ssize_t)reply.size())
+            perror("Replay");
+
+    }else if(cmd[0] == 0x43){   //Sample rate
+        uint32_t sr;
+        memcpy(&sr, cmd, sizeof(sr));
+        if(sr != header.sr_cmd)
+            printf("Replay: the capture was recorded at %u Hz, it is replayed as it is\n", header.sr_cmd >> 8);
+
+    }else if(cmd[0] == 0x13 || cmd[0] == 0x23 || cmd[0] == 0x33){  //API mode, the outputs and DAC commands also end in 0b0011
+        if((uint32_t)(cmd[0] >> 4) != header.api_mode)
+            printf("Replay: the capture was recorded in API mode %u, it is replayed as it is\n", header.api_mode);
+
+    }else if(cmd[0] == 0x01 || cmd[0] == 0x02){     //Live or simulated mode, the capture starts over
+        const uint16_t live = cmd[0] | (cmd[1] << 8);
+        if(live != (uint16_t)header.live_cmd)
+            printf("Replay: the capture was recorded with channel mask 0x%02X, it is replayed as it is\n", header.live_cmd >> 8);
+
+        fseek(file, data_offset, SEEK_SET);
+        chunk.clear();
+        chunk_sent = 0;
+        streaming = true;
+        stream_start = std::chrono::steady_clock::now();
+
+    }else if(cmd[0] == 0x00){   //Idle mode
+        streaming = false;
+    }
+}
+
+/*****************************************************************************/
+
+void Replay::run(void){
+    uint8_t cmd[CMD_MAX_BYTES];
+    int cmd_len = 0;
+
+    while(!quit){
+        int timeout_ms = REPLAY_POLL_MS;
+        pollfd pfd = {fd, POLLIN, 0};
+
+        if(streaming){
+            if(chunk_sent == chunk.size() && !nextChunk()){
+                shutdown(fd, SHUT_WR);      //End of the capture, the reader sees the link closing
+                streaming = false;
+                continue;
+            }
+
+            //Real time divided by the speed factor, or as fast as the reader takes the data
+            if(speed <= 0){
+                pfd.events |= POLLOUT;
+            }else{
+                const std::chrono::steady_clock::time_point due = stream_start + std::chrono::microseconds((int64_t)(chunk_time_us/speed));
+                const int64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(due - std::chrono::steady_clock::now()).count();
+                if(wait_us <= 0)
+                    pfd.events |= POLLOUT;
+                else
+                    timeout_ms = std::min((int64_t)REPLAY_POLL_MS, (wait_us+999)/1000);
+            }
+        }
+
+        if(poll(&pfd, 1, timeout_ms) < 0){
+            if(errno == EINTR)   continue;
+            perror("Replay");
+            return;
+        }
+
+        if(pfd.revents & (POLLIN | POLLHUP)){
+            ssize_t ret = ::recv(fd, cmd+cmd_len, sizeof(cmd)-cmd_len, 0);
+            if(ret == 0)   return;      //The host closed the link
+            if(ret > 0){
+                cmd_len += ret;
+                if(cmd_len == (int)sizeof(cmd)){    //Commands are sent with a fixed size over sockets
+                    command(cmd);
+                    cmd_len = 0;
+                }
+                continue;   //The command may have changed the stream
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)   return;
+        }
+
+        if(pfd.revents & POLLOUT){
+            ssize_t ret = ::send(fd, &chunk[chunk_sent], chunk.size()-chunk_sent, MSG_NOSIGNAL);
+            if(ret > 0)
+                chunk_sent += ret;
+            else if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                return;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "esp_adc.h"
+#include "writer.h"
+
+#define REPLAY_MAGIC        0x50434353      //"SCCP" read as a little endian integer
+#define REPLAY_VERSION      1
+#define REPLAY_MAX_CHUNK    (1024*1024)     //Largest chunk accepted when reading a capture
+#define REPLAY_POLL_MS      100             //Longest wait of the replay thread while it is not streaming
+
+// Raw capture of the bytes a device sent during an acquisition, as they arrived, in host byte order:
+//   header: uint32 REPLAY_MAGIC, uint32 REPLAY_VERSION, uint32 api_mode, uint32 sample rate command,
+//           uint32 live mode command, uint32 firmware length, the firmware version string, uint32 adc_chars[6]
+//   chunk:  int64 host time of arrival in us since the live mode command, uint32 size and size bytes received
+struct CaptureHeader
+{
+    uint32_t api_mode;
+    uint32_t sr_cmd;                ///< Sample rate command sent by start()
+    uint32_t live_cmd;              ///< Live mode command sent by start(), with the channel mask
+    std::string firmware_version;
+    esp_adc_cal_characteristics_t adc_chars;
+};
+
+/** Reads the header and all the bytes received of a capture, in the order they arrived.
+    * \return false if the file cannot be read or is not a capture
+    */
+bool readCapture(const char *file_name, CaptureHeader &header, std::vector<uint8_t> &data);
+
+// Writes a raw capture, see ScientISST::capture().
+class CaptureWriter
+{
+public:
+    /// Creates the file and writes the header, returns false if it cannot be created.
+    bool open(const char *file_name, const CaptureHeader &header);
+
+    /// Appends the bytes of one read from the link.
+    void write(const void *data, int len);
+
+    void close(void);
+
+    bool isOpen(void) const { return file.isOpen(); }
+
+private:
+    FileWriter file;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Plays a raw capture back as a device would, on the device end of a loopback link: it answers the version
+// command with the captured firmware version and adc characteristics and, after the live mode command,
+// sends the captured bytes with their original timing divided by the speed factor, or as fast as the
+// reader takes them if the speed is 0. Other commands are ignored. At the end of the capture the
+// stream is shut down, so the reader sees the link closing.
+class Replay
+{
+public:
+    Replay(void) : fd(-1) {}
+    ~Replay() { close(); }
+
+    /** Opens a capture and starts the replay thread.
+        * \param[in] _fd Device end of the link, see LoopbackTransport::peer(). It is not closed by the replay.
+        * \return false if the capture cannot be read
+        */
+    bool open(const char *file_name, double speed, int _fd);
+
+    /// Stops the replay thread.
+    void close(void);
+
+private:
+    bool readHeader(void);
+    bool nextChunk(void);
+    void command(const uint8_t *cmd);
+    void run(void);
+
+    FILE *file;
+    long data_offset;               //Start of the chunks in the file
+    CaptureHeader header;
+    double speed;
+    int fd;                         //Device end of the link
+
+    //Used by the replay thread
+    bool streaming;
+    std::chrono::steady_clock::time_point stream_start;
+    int64_t chunk_time_us;
+    std::vector<uint8_t> chunk;     //Chunk being sent
+    size_t chunk_sent;
+    std::thread thread;
+    std::atomic<bool> quit;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "scheduler.h"
+
+using std::chrono::steady_clock;
+
+OutputScheduler::OutputScheduler(ScientISST &_dev) : dev(_dev), sending(false), stopping(false) {
+    thread = std::thread(&OutputScheduler::worker, this);
+}
+
+/*****************************************************************************/
+
+OutputScheduler::~OutputScheduler(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        pending.clear();
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+/*****************************************************************************/
+
+void OutputScheduler::trigger(steady_clock::time_point at, const ScientISST::Vbool &digitalOutput){
+    OutputEvent event;
+
+    if(digitalOutput.size() != 0 && digitalOutput.size() != 2)   throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+
+    event.type = OUTPUT_DIGITAL;
+    event.value = digitalOutput.empty() ? 0 : (digitalOutput[0] ? 1 : 0) | (digitalOutput[1] ? 2 : 0);
+    event.target = at;
+    schedule(event);
+}
+
+/*****************************************************************************/
+
+void OutputScheduler::dac(steady_clock::time_point at, int pwmOutput){
+    OutputEvent event;
+
+    if(pwmOutput < 0 || pwmOutput > 255)   throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+
+    event.type = OUTPUT_DAC;
+    event.value = pwmOutput;
+    event.target = at;
+    schedule(event);
+}
+
+/*****************************************************************************/
+
+steady_clock::time_point OutputScheduler::frameTime(double frame) const{
+    if(dev.num_chs == 0)   throw ScientISST::Exception(ScientISST::Exception::DEVICE_NOT_IN_ACQUISITION);
+
+    return dev.live_time + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(frame/dev.sample_rate));
+}
+
+/*****************************************************************************/
+
+void OutputScheduler::schedule(const OutputEvent &event){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.insert(std::make_pair(event.target, event));
+    }
+    cv.notify_all();
+}
+
+/*****************************************************************************/
+
+void OutputScheduler::drain(void){
+    std::unique_lock<std::mutex> lock(mutex);
+
+    cv.wait(lock, [this](){ return (pending.empty() && !sending) || stopping; });
+}
+
+/*****************************************************************************/
+
+void OutputScheduler::cancel(void){
+    std::unique_lock<std::mutex> lock(mutex);
+
+    pending.clear();
+    cv.notify_all();
+    cv.wait(lock, [this](){ return !sending; });    //The command being sent is not cancelled
+}
+
+/*****************************************************************************/
+
+std::vector<OutputEvent> OutputScheduler::history(void){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return log;
+}
+
+/*****************************************************************************/
+
+void OutputScheduler::worker(void){
+    std::unique_lock<std::mutex> lock(mutex);
+    ScientISST::Vbool outputs(2);
+
+    while(!stopping){
+        if(pending.empty()){
+            cv.wait(lock);
+            continue;
+        }
+
+        //Sleep until shortly before the next command, or until a command is scheduled or cancelled
+        const steady_clock::time_point target = pending.begin()->first;
+        if(steady_clock::now() < target - std::chrono::microseconds(SCHEDULER_SPIN_US)){
+            cv.wait_until(lock, target - std::chrono::microseconds(SCHEDULER_SPIN_US));
+            continue;
+        }
+
+        OutputEvent event = pending.begin()->second;
+        pending.erase(pending.begin());
+        sending = true;
+        lock.unlock();
+
+        if(event.type == OUTPUT_DIGITAL){
+            outputs[0] = event.value & 1;
+            outputs[1] = (event.value >> 1) & 1;
+        }
+
+        //The sleep may end up to a scheduler tick late, the clock is polled for the rest of the wait
+        while(steady_clock::now() < target){}
+
+        event.sent = steady_clock::now();
+        event.error = 0;
+        try{
+            if(event.type == OUTPUT_DIGITAL){
+                dev.setOutputs(outputs, false);
+            }else{
+                dev.setDac(event.value, false);
+            }
+        }catch(ScientISST::Exception &e){
+            event.error = e.code;
+        }
+        event.frame = dev.num_chs ? std::chrono::duration<double>(event.sent - dev.live_time).count()*dev.sample_rate : -1;
+
+        lock.lock();
+        log.push_back(event);
+        sending = false;
+        cv.notify_all();
+    }
+}
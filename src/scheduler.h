@@ -0,0 +1,78 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "scientisst.h"
+
+#define SCHEDULER_SPIN_US   2000    //The last part of the wait for a command is spent polling the clock instead of sleeping
+
+#define OUTPUT_DIGITAL      0       //Digital outputs command, see ScientISST::trigger()
+#define OUTPUT_DAC          1       //Analog output command, see ScientISST::dac()
+
+/// A command of an OutputScheduler and, once sent, when it was sent.
+struct OutputEvent
+{
+    int type;               ///< OUTPUT_DIGITAL or OUTPUT_DAC
+    int value;              ///< O1 and O2 as bits 0 and 1, or the DAC value (0...255)
+    std::chrono::steady_clock::time_point target;   ///< Time it was scheduled for
+    std::chrono::steady_clock::time_point sent;     ///< Time it was handed to the link
+    double frame;           ///< sent on the acquisition timeline, in frames since the live mode command, -1 if idle
+    int error;              ///< 0 or the ScientISST::Exception::Code of the send
+};
+
+// Sends digital output and DAC commands of a device at given times, from a thread of its own. The commands skip
+// the pause between commands of ScientISST::trigger() and dac(): the thread sleeps until shortly before the
+// target time and polls the clock for the last SCHEDULER_SPIN_US. Each sent command is logged with its send time,
+// also placed on the acquisition timeline, see history().
+// The device may be read by another thread meanwhile, but no other command may be sent to it while commands are
+// pending: call drain() or cancel() before ScientISST::stop() or any other command.
+class OutputScheduler
+{
+public:
+    OutputScheduler(ScientISST &_dev);
+
+    /// Drops the commands not sent yet and stops the thread.
+    ~OutputScheduler();
+
+    /** Schedules the digital outputs (O1, O2), as ScientISST::trigger() sets them. A time already past sends it at once.
+        * \exception ScientISST::Exception (INVALID_PARAMETER)
+        */
+    void trigger(std::chrono::steady_clock::time_point at, const ScientISST::Vbool &digitalOutput);
+
+    /** Schedules the analog output value (0...255), as ScientISST::dac() sets it.
+        * \exception ScientISST::Exception (INVALID_PARAMETER)
+        */
+    void dac(std::chrono::steady_clock::time_point at, int pwmOutput);
+
+    /// Host time of a frame of the current acquisition, counted from the live mode command, to schedule commands on the timeline.
+    std::chrono::steady_clock::time_point frameTime(double frame) const;
+
+    /// Waits until every scheduled command was sent.
+    void drain(void);
+
+    /// Drops the commands not sent yet.
+    void cancel(void);
+
+    /// Returns a copy of the log of the sent commands, oldest first.
+    std::vector<OutputEvent> history(void);
+
+private:
+    void schedule(const OutputEvent &event);
+    void worker(void);
+
+    ScientISST &dev;
+    std::mutex mutex;                   //Guards pending, log, sending and stopping
+    std::condition_variable cv;
+    std::multimap<std::chrono::steady_clock::time_point, OutputEvent> pending;  //By target time, in order of scheduling for the same time
+    std::vector<OutputEvent> log;
+    bool sending;                       //The worker took a command out of pending and hasn't logged it yet
+    bool stopping;
+    std::thread thread;
+};
+
+#endif
@@ -11,14 +11,11 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <fcntl.h>
-#include <termios.h>
 #include <unistd.h>
 
 #ifdef HASBLUETOOTH  // Linux only
 
 #include <bluetooth/bluetooth.h>
-#include <bluetooth/rfcomm.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
 #include <stdlib.h>
@@ -33,40 +30,16 @@ void Sleep(int millisecs)
 #endif // Linux or Mac OS
 
 #include <algorithm>    // std::sort
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "scientisst.h"
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include "../ext/rapidjson/include/rapidjson/document.h"
-#include "../ext/rapidjson/include/rapidjson/writer.h"
-#include "../ext/rapidjson/include/rapidjson/stringbuffer.h"
-#include "tcp.h"
-#include "udp.h"
-
-
-/*****************************************************************************/
-
-// CRC4 check function
-
-static const unsigned char CRC4tab[16] = {0, 3, 6, 5, 12, 15, 10, 9, 11, 8, 13, 14, 7, 4, 1, 2};
-
-static bool checkCRC4(const unsigned char *data, int len)
-{
-   unsigned char crc = 0;
-
-   for (int i = 0; i < len-1; i++)
-   {
-      const unsigned char b = data[i];
-      crc = CRC4tab[crc] ^ (b >> 4);
-      crc = CRC4tab[crc] ^ (b & 0x0F);
-   }
-
-   // CRC for last byte
-   crc = CRC4tab[crc] ^ (data[len-1] >> 4);
-   crc = CRC4tab[crc];
-
-   return (crc == (data[len-1] & 0x0F));
-}
+#include "inventory.h"
+#include "packet.h"
 
 /*****************************************************************************/
 
@@ -151,21 +124,65 @@ ScientISST::VDevInfo ScientISST::find(void)
       ::close(sock);
       throw Exception(Exception::PORT_INITIALIZATION);
     }
+    ::close(sock);
+
+    // Devices already in the inventory keep their cached name, the others are resolved
+    // in parallel, each worker with its own HCI socket
+    Inventory &inventory = Inventory::instance();
+    VDevInfo found(num_rsp);
+    std::vector<int> unresolved;
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
 
     for (int i = 0; i < num_rsp; i++)
     {
-        char addr[19], name[248];
+        char addr[19];
+        Inventory::Entry entry;
 
         ba2str(&ii[i].bdaddr, addr);
-        if (hci_read_remote_name(sock, &ii[i].bdaddr, sizeof name, name, 0) >= 0)
+        found[i].macAddr = addr;
+        if (inventory.lookup(addr, entry) && !entry.name.empty())
         {
-           devInfo.macAddr = addr;
-           devInfo.name = name;
-           devs.push_back(devInfo);        
+           found[i].name = entry.name;
+           found[i].firmware = entry.firmware;
         }
+        else
+           unresolved.push_back(i);
+    }
+
+    for (int w = 0; w < DISCOVERY_THREADS && w < (int)unresolved.size(); w++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            int worker_sock = hci_open_dev(dev_id);
+            if (worker_sock < 0)   return;
+
+            for (int k = next++; k < (int)unresolved.size(); k = next++)
+            {
+                char name[248];
+                const int i = unresolved[k];
+                if (hci_read_remote_name(worker_sock, &ii[i].bdaddr, sizeof name, name, DISCOVERY_NAME_TIMEOUT_MS) >= 0)
+                   found[i].name = name;
+            }
+            ::close(worker_sock);
+        }));
+    }
+    for (size_t w = 0; w < workers.size(); w++)
+        workers[w].join();
+
+    for (int i = 0; i < num_rsp; i++)
+    {
+        Inventory::Entry entry;
+
+        if (found[i].name.empty())   continue;    // remote name request failed
+        devs.push_back(found[i]);
+
+        inventory.lookup(found[i].macAddr, entry);
+        entry.macAddr = found[i].macAddr;
+        entry.name = found[i].name;
+        inventory.update(entry);
     }
 
-    ::close(sock);
     if (pii != ii)   free(pii);
    
 #else
@@ -181,219 +198,59 @@ ScientISST::VDevInfo ScientISST::find(void)
 
 /*****************************************************************************/
 
-ScientISST::ScientISST(const char *address) : num_chs(0){
-#ifdef _WIN32
-   if (_memicmp(address, "COM", 3) == 0)
-   {
-      fd = INVALID_SOCKET;
-
-	   char xport[40] = "\\\\.\\";   // preppend "\\.\"
-
-	   strcat_s(xport, 40, address);
-
-	   hCom = CreateFileA(xport,  // comm port name
-					   GENERIC_READ | GENERIC_WRITE,
-					   0,      // comm devices must be opened w/exclusive-access 
-					   NULL,   // no security attributes 
-					   OPEN_EXISTING, // comm devices must use OPEN_EXISTING 
-					   0,      // not overlapped I/O 
-					   NULL);  // hTemplate must be NULL for comm devices 
-
-      if (hCom == INVALID_HANDLE_VALUE)
-         throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
-
-      DCB dcb;
-      if (!GetCommState(hCom, &dcb))
-	   {
-		   close();
-		   throw Exception(Exception::PORT_INITIALIZATION);
-	   }
-      dcb.BaudRate = CBR_115200;
-      dcb.fBinary = TRUE;
-      dcb.fParity = FALSE;
-      dcb.fOutxCtsFlow = FALSE;
-      dcb.fOutxDsrFlow = FALSE;
-      dcb.fDtrControl = DTR_CONTROL_DISABLE;
-      dcb.fDsrSensitivity = FALSE;
-      dcb.fOutX = FALSE;
-      dcb.fInX = FALSE;
-      dcb.fNull = FALSE;
-      dcb.fRtsControl = RTS_CONTROL_ENABLE;
-      dcb.ByteSize = 8;
-      dcb.Parity = NOPARITY;
-      dcb.StopBits = ONESTOPBIT;
-      if (!SetCommState(hCom, &dcb))
-	   {
-		   close();
-		   throw Exception(Exception::PORT_INITIALIZATION);
-	   }
-
-	   COMMTIMEOUTS ct;
-	   ct.ReadIntervalTimeout         = 0;
-	   ct.ReadTotalTimeoutConstant    = 5000; // 5 s
-	   ct.ReadTotalTimeoutMultiplier  = 0;
-	   ct.WriteTotalTimeoutConstant   = 5000; // 5 s
-	   ct.WriteTotalTimeoutMultiplier = 0;
-
-	   if (!SetCommTimeouts(hCom, &ct)) 
-	   {
-		   close();
-		   throw Exception(Exception::PORT_INITIALIZATION);
-	   }
-   }
-   else // address is a Bluetooth MAC address
-   {
-      hCom = INVALID_HANDLE_VALUE;
-
-      WSADATA m_data;
-      if (WSAStartup(0x202, &m_data) != 0)
-         throw Exception(Exception::PORT_INITIALIZATION);
-
-      SOCKADDR_BTH so_bt;
-      int siz = sizeof so_bt;
-      if (WSAStringToAddressA((LPSTR)address, AF_BTH, NULL, (sockaddr*)&so_bt, &siz) != 0)
-      {
-         WSACleanup();
-         throw Exception(Exception::INVALID_ADDRESS);
-      }
-      so_bt.port = 1;
-
-      fd = socket(AF_BTH, SOCK_STREAM, BTHPROTO_RFCOMM);
-      if (fd == INVALID_SOCKET)
-      {
-         WSACleanup();
-         throw Exception(Exception::PORT_INITIALIZATION);
-      }
-
-      DWORD rcvbufsiz = 128*1024; // 128k
-      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*) &rcvbufsiz, sizeof rcvbufsiz);
-
-      if (connect(fd, (const sockaddr*)&so_bt, sizeof so_bt) != 0)
-      {
-         int err = WSAGetLastError();
-         close();
-
-         switch(err)
-         {
-         case WSAENETDOWN:
-            throw Exception(Exception::BT_ADAPTER_NOT_FOUND);
-
-         case WSAETIMEDOUT:
-            throw Exception(Exception::DEVICE_NOT_FOUND);
-
-         default:
-            throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
-         }
-      }
-
-      readtimeout.tv_sec = 5;
-      readtimeout.tv_usec = 0;
-   }
-
-#else // Linux or Mac OS
-
-    if (memcmp(address, "/dev/", 5) == 0)
-    {   
-        fd = open(address, O_RDWR | O_NOCTTY | O_NDELAY);
-        if (fd < 0)
-            throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
-        
-        if (fcntl(fd, F_SETFL, 0) == -1)  // remove the O_NDELAY flag
-        {
-            close();
-            throw Exception(Exception::PORT_INITIALIZATION);
-        }
-    
-        termios term;
-        if (tcgetattr(fd, &term) != 0)
-        {
-            close();
-            throw Exception(Exception::PORT_INITIALIZATION);
-        }
-    
-        cfmakeraw(&term);
-        term.c_oflag &= ~(OPOST);
-    
-        term.c_cc[VMIN] = 1;
-        term.c_cc[VTIME] = 1;
-    
-        term.c_iflag &= ~(INPCK | PARMRK | ISTRIP | IGNCR | ICRNL | INLCR | IXON | IXOFF | IMAXBEL); // no flow control
-        term.c_iflag |= (IGNPAR | IGNBRK);
-    
-        term.c_cflag &= ~(CRTSCTS | PARENB | CSTOPB | CSIZE); // no parity, 1 stop bit
-        term.c_cflag |= (CLOCAL | CREAD | CS8);    // raw mode, 8 bits
-    
-        term.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHOPRT | ECHOK | ECHOKE | ECHONL | ECHOCTL | ISIG | IEXTEN | TOSTOP);  // raw mode
-    
-        if (cfsetspeed(&term, B115200) != 0)
-        {
-            close();
-            throw Exception(Exception::PORT_INITIALIZATION);
-        }
-    
-        if (tcsetattr(fd, TCSANOW, &term) != 0)
-        {
-            close();
-            throw Exception(Exception::PORT_INITIALIZATION);
-        }
+ScientISST::VDevInfo ScientISST::known(void)
+{
+    VDevInfo devs;
+    Inventory::VEntry entries = Inventory::instance().entries();
 
-        //isTTY = true;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        DevInfo devInfo;
+        devInfo.macAddr = entries[i].macAddr;
+        devInfo.name = entries[i].name;
+        devInfo.firmware = entries[i].firmware;
+        devs.push_back(devInfo);
+    }
 
-        com_mode = COM_MODE_UART;
+    return devs;
+}
 
-    //Setup as an Wifi server
-    }else if(memcmp(address, "server", 6) == 0){
-        char *port_str;
+/*****************************************************************************/
 
-        port_str = (char*)strrchr(address, ':')+1;  //+1 to remove the ':'
-        if(port_str == NULL){
-            printf("Error in reading server port number, example usage: ./scientisst server_tcp:25565\n");
-            exit(-1);
-        }
+void ScientISST::serveMetrics(const char *address)
+{
+    if (!::serveMetrics(address))
+        throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+}
 
-        //Tcp server
-        if(memcmp(strrchr(address, '_')+1, "tcp", 3) == 0){
-            com_mode = COM_MODE_TCP_SV;
-            fd = initTcpServer(port_str);
-        //Udp server
-        }else if(memcmp(strrchr(address, '_')+1, "udp", 3) == 0){
-            com_mode = COM_MODE_UDP;
-            fd = initUdpServer(port_str, &client_addr, &client_addr_len);
-        }
+/*****************************************************************************/
 
+ScientISST::ScientISST(const char *address) : num_chs(0){
+    link = Transport::open(address);
+    init(address);
+}
 
-    }else // address is a Bluetooth MAC address
-#ifdef HASBLUETOOTH
-    {
-        sockaddr_rc so_bt;
-        so_bt.rc_family = AF_BLUETOOTH;
-        if (str2ba(address, &so_bt.rc_bdaddr) < 0)
-            throw Exception(Exception::INVALID_ADDRESS);
-            
-        so_bt.rc_channel = 1;
-
-        fd = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
-        if (fd < 0)
-            throw Exception(Exception::PORT_INITIALIZATION);
-
-        if (connect(fd, (const sockaddr*)&so_bt, sizeof so_bt) != 0)
-        {
-            close();
-            throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
-        }
+/*****************************************************************************/
 
-        //isTTY = false;
-        com_mode = COM_MODE_BT;
-    }
-#else
-        throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
-#endif // HASBLUETOOTH
+ScientISST::ScientISST(Transport *_link, const char *label) : num_chs(0){
+    link = _link;
+    init(label);
+}
 
-#endif // Linux or Mac OS
+/*****************************************************************************/
 
+void ScientISST::init(const char *label){
+    device_key = link->key;
     api_mode =  API_MODE_SCIENTISST;
-    output_fd = NULL;
+    file_sink = NULL;
     bytes_to_read = 0;
+    supervised = (link->mode == COM_MODE_TCP_CL);
+    gap_ms = -1;
+    resyncing = false;
+    block_ms = 0;
+    metrics.label(label);
+    adc_cache_mode = ADC_CACHE_ON;
+    adc_chars_valid = false;
 }
 
 /*****************************************************************************/
@@ -406,7 +263,8 @@ ScientISST::~ScientISST(void)
     }
     catch (Exception) {} // if stop() fails, close anyway
 
-    close();
+    delete file_sink;
+    delete link;
 }
 
 /*****************************************************************************/
@@ -414,12 +272,12 @@ ScientISST::~ScientISST(void)
 void ScientISST::changeAPI(uint8_t api){
     if (num_chs != 0)   throw Exception(Exception::DEVICE_NOT_IDLE);
 
-    api_mode = api;
-
     if(api <= 0 || api > 3){
-        throw(Exception::INVALID_PARAMETER);
+        throw Exception(Exception::INVALID_PARAMETER);
     }
 
+    api_mode = api;
+
     api <<= 4;
     api |= 0b11;
 
@@ -453,25 +311,30 @@ void ScientISST::versionAndAdcChars(void){
     adc_chars_size = rcv_bytes-firmware_str_size;
     
     //Put recieved firmware string into firmware_version
-    for(int i = 0; i < firmware_str_size; i++){
-        firmware_version.push_back(firmware_str[i]);
-    }
+    firmware_version.assign((const char*)firmware_str);
 
     //Copy data of recieved adc chars into adc1_chars
     if(adc_chars_size != 6*sizeof(uint32_t)){
         printf("Error, recieved %dbytes, of which %dbytes are for adc_chars and was expecting %ldbytes\n", rcv_bytes, adc_chars_size, 6*sizeof(uint32_t));
-        throw Exception::INVALID_PARAMETER;
+        throw Exception(Exception::INVALID_PARAMETER);
     }
     memcpy(&adc1_chars, adc_chars, adc_chars_size);
-
-    //Initialize fields for lookup table if necessary
-    if (LUT_ENABLED && adc1_chars.atten == ADC_ATTEN_DB_11) {
-        adc1_chars.low_curve = (adc1_chars.adc_num == ADC_UNIT_1) ? lut_adc1_low : lut_adc2_low;
-        adc1_chars.high_curve = (adc1_chars.adc_num == ADC_UNIT_1) ? lut_adc1_high : lut_adc2_high;
-    } else {
-        adc1_chars.low_curve = NULL;
-        adc1_chars.high_curve = NULL;
+    initAdcLut(&adc1_chars);
+
+    //Remember the device, so discovery and later sessions know its firmware and characteristics
+    if(!device_key.empty()){
+        Inventory::Entry entry;
+        if(Inventory::instance().lookup(device_key, entry) && entry.hasAdcChars &&
+           (entry.firmware != firmware_version || memcmp(&entry.adcChars, &adc1_chars, 6*sizeof(uint32_t)) != 0)){
+            printf("ScientISST characteristics changed since they were cached, updating the cache\n");
+        }
+        entry.macAddr = device_key;
+        entry.firmware = firmware_version;
+        entry.hasAdcChars = true;
+        entry.adcChars = adc1_chars;
+        Inventory::instance().update(entry);
     }
+    adc_chars_valid = true;
 
     printf("ScientISST version: %s\n", firmware_version.c_str());
     printf("ScientISST Board Vref:%d\n", adc1_chars.vref);
@@ -479,75 +342,61 @@ void ScientISST::versionAndAdcChars(void){
 
 }
 
-int ScientISST::getPacketSize(){
-    uint8_t _packet_size = 0;
-    int num_intern_active_chs = 0;
-    int num_extern_active_chs = 0;
-    rapidjson::Document d;
-    char value_internal_str[50];
-    char value_external_str[50];
-    char aux_str[50];
-    rapidjson::Value classname;
-    rapidjson::Value member_name(aux_str, strlen(aux_str), d.GetAllocator());
-    rapidjson::Value member_value(aux_str, strlen(aux_str), d.GetAllocator());
+/*****************************************************************************/
 
-    for(int i = 0; i < num_chs; i++){
-        //Add 24bit channel's contributuion to packet size
-        if(chs[i] == AX1 || chs[i] == AX2){
-            num_extern_active_chs++;
-        
-        //Count 12bit channels
-        }else{
-            num_intern_active_chs++;
-        }
-    } 
+void ScientISST::cacheAdcChars(int mode){
+    if(mode != ADC_CACHE_OFF && mode != ADC_CACHE_ON && mode != ADC_CACHE_VALIDATE)   throw Exception(Exception::INVALID_PARAMETER);
 
-    if(api_mode == API_MODE_SCIENTISST){       
-        //Add 24bit channel's contributuion to packet size
-        _packet_size = 3*num_extern_active_chs;
+    adc_cache_mode = mode;
+    adc_chars_valid = false;    //Characteristics of this connection must come from the device or the disk cache again
+}
 
-        //Add 12bit channel's contributuion to packet size 
-        if(!(num_intern_active_chs % 2)){                    //If it's an even number
-            _packet_size += ((num_intern_active_chs*12)/8);
-        }else{
-            _packet_size += (((num_intern_active_chs*12)-4)/8); //-4 because 4 bits can go in the I/0 byte 
-        }
-        _packet_size += 2;  //for the I/Os and seq+crc bytes
+/*****************************************************************************/
 
-    }else if(api_mode == API_MODE_JSON){
-        d.SetObject();
+// Gets the version string and adc characteristics without asking the device, from what this connection
+// already received or, unless validating, from the inventory. Returns false if versionAndAdcChars() is needed.
+bool ScientISST::loadAdcChars(void){
+    Inventory::Entry entry;
+
+    if(adc_cache_mode == ADC_CACHE_OFF)   return false;
+    if(adc_chars_valid)   return true;
 
-        //Load value strings with channels' respective max values
-        sprintf(value_internal_str, "%04d", 4095);     
-        sprintf(value_external_str, "%08d", 16777215);
+    if(adc_cache_mode != ADC_CACHE_ON || device_key.empty())   return false;
+    if(!Inventory::instance().lookup(device_key, entry) || !entry.hasAdcChars)   return false;
+
+    firmware_version = entry.firmware;
+    adc1_chars = entry.adcChars;
+    initAdcLut(&adc1_chars);
+    adc_chars_valid = true;
+
+    printf("ScientISST version: %s (cached)\n", firmware_version.c_str());
+    return true;
+}
+
+/*****************************************************************************/
+
+int ScientISST::getPacketSize(){
+    uint8_t _packet_size = 0;
+
+    if(api_mode == API_MODE_SCIENTISST){
+        _packet_size = packetSize(chs, num_chs);
+
+    }else if(api_mode == API_MODE_JSON){
+        //The device sends each frame as this object with every value at its widest, followed by '\0'
+        char packet[256];
+        int len = sprintf(packet, "{");
 
         for(int i = 0; i < num_chs; i++){
-            //If it's internal ch
             if(chs[i] <= 6){
-                sprintf(aux_str, "AI%d", chs[i]);
-                member_name.SetString(aux_str, d.GetAllocator());
-                member_value.SetString(value_internal_str, d.GetAllocator());
-                d.AddMember(member_name, member_value, d.GetAllocator());
-                
+                len += sprintf(packet+len, "\"AI%d\":\"%04d\",", chs[i], 4095);
             }else{
-                sprintf(aux_str, "AX%d", chs[i]-6);
-                member_name.SetString(aux_str, d.GetAllocator());
-                member_value.SetString(value_external_str, d.GetAllocator());
-                d.AddMember(member_name, member_value, d.GetAllocator());
-            }   
+                len += sprintf(packet+len, "\"AX%d\":\"%08d\",", chs[i]-6, 16777215);
+            }
         }
-        //Add IO state json objects
-        d.AddMember("I1", "0", d.GetAllocator());
-        d.AddMember("I2", "0", d.GetAllocator());
-        d.AddMember("O1", "0", d.GetAllocator());
-        d.AddMember("O2", "0", d.GetAllocator());
-
-        // 3. Stringify the DOM
-        rapidjson::StringBuffer buffer;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-        d.Accept(writer);
-
-        _packet_size = strlen(buffer.GetString())+1;
+        //IO states
+        len += sprintf(packet+len, "\"I1\":\"0\",\"I2\":\"0\",\"O1\":\"0\",\"O2\":\"0\"}");
+
+        _packet_size = len+1;
     }
     return _packet_size;
 }
@@ -555,87 +404,161 @@ int ScientISST::getPacketSize(){
 /*****************************************************************************/
 
 void ScientISST::start(int _sample_rate, const Vint &channels, const char* file_name, bool simulated, int api){
-    uint8_t buffer[10];
+    prepareStart(_sample_rate, channels, simulated, api);
+    goLive(true);
+    openOutputs(file_name);
+}
+
+/*****************************************************************************/
+
+// First part of start(): everything but the live mode command, which is left in live_cmd.
+void ScientISST::prepareStart(int _sample_rate, const Vint &channels, bool simulated, int api){
     uint32_t sr;
     uint16_t cmd;
     char chMask;
+    int new_chs[8];
+    int new_num_chs = 0;
     int num_frames = 0;
 
-    sample_rate = _sample_rate;
-    
     if (num_chs != 0)   throw Exception(Exception::DEVICE_NOT_IDLE);
 
     if(api != API_MODE_JSON && api != API_MODE_SCIENTISST){
         throw Exception(Exception::INVALID_PARAMETER);
     }
 
-    //Clear chs vec
-    memset(chs, 0, 8*sizeof(int));
-    num_chs = 0;
-
-    //Change API mode
-    changeAPI(api);
-
-
-    versionAndAdcChars();    // get device version string and adc characteristics
-
-    
-    //Sample rate
-    sr = 0b01000011;
-    sr |= _sample_rate << 8;
-    send((uint8_t*)&sr, sizeof(sr));
-    
+    //Channels are validated before anything is changed, the device stays idle if they are invalid
+    memset(new_chs, 0, 8*sizeof(int));
     if(channels.empty()){
         chMask = 0xFF;    // all 8 analog channels
-        num_chs = 8;
+        for(new_num_chs = 0; new_num_chs < 8; new_num_chs++)
+            new_chs[new_num_chs] = new_num_chs+1;
     }else{
         chMask = 0;
         for(Vint::const_iterator it = channels.begin(); it != channels.end(); it++){
             int ch = *it;
-            chs[num_chs] = ch;        //Fill chs vector
             if (ch <= 0 || ch > 8)   throw Exception(Exception::INVALID_PARAMETER);
             const char mask = 1 << (ch-1);
             if (chMask & mask)   throw Exception(Exception::INVALID_PARAMETER);
             chMask |= mask;
-            num_chs++;
+            new_chs[new_num_chs++] = ch;        //Fill chs vector
         }
     }
+
+    sample_rate = _sample_rate;
+
+    //Change API mode
+    changeAPI(api);
+
+
+    if(!loadAdcChars())
+        versionAndAdcChars();    // get device version string and adc characteristics
+
     
-    //Cleanup existing data in stream socket
-    if(com_mode != COM_MODE_UDP){
-        while(recv(buffer, 1) == 1);
+    //Sample rate
+    sr = 0b01000011;
+    sr |= _sample_rate << 8;
+    send((uint8_t*)&sr, sizeof(sr));
+    
+    memcpy(chs, new_chs, 8*sizeof(int));
+    num_chs = new_num_chs;
+
+    //From here on the device counts as in acquisition, any failure must leave it idle again
+    try{
+        packet_size = getPacketSize();
+
+        if(block_ms > 0){
+            //Frames of block_ms at the requested rate, as many as a read() can buffer
+            const long max_frames = MAX_BLOCK_BYTES/packet_size - 1;
+            bytes_to_read = std::max(1L, std::min((long)sample_rate*block_ms/1000, max_frames)) * packet_size;
+        }else if(sample_rate > 100){
+            bytes_to_read = !(MAX_BUFFER_SIZE%packet_size) ? MAX_BUFFER_SIZE-packet_size : MAX_BUFFER_SIZE-(MAX_BUFFER_SIZE%packet_size);
+        }else{
+            bytes_to_read = packet_size;
+        }
+
+        if(bytes_to_read % packet_size){
+            printf("Error, bytes_to_read needs to be devisible by packet_size\n");
+            exit(EXIT_FAILURE);
+        }else{
+            num_frames = bytes_to_read/packet_size;
+        }
+
+        //The buffers of a device are reused by its next acquisitions, they are only reallocated to grow
+        frames.resize(num_frames);  // resize the frames vector with num_frames frames
+        rcv_buffer.resize(bytes_to_read+packet_size);   //One packet more for the bytes skipped while resynchronizing
+
+        block.resize(num_chs, num_frames);
+        for(int i = 0; i < num_chs; i++)
+            block.chs[i] = chs[i];
+        statistics.reset(block, sample_rate);
+        resyncing = false;
+
+        if(!dsp.configure(dsp_config, sample_rate, num_chs, num_frames))
+            throw Exception(Exception::INVALID_PARAMETER);
+        block.sample_rate = dsp.enabled() ? (double)sample_rate/dsp_config.decimation : sample_rate;
+
+        //Cleanup existing data in stream socket
+        flush();
+
+        link->setReadSize(packet_size, bytes_to_read);
+    }catch(...){
+        num_chs = 0;
+        throw;
     }
    
-    //Send live mode command with channels mask
+    //Live mode command with channels mask
     cmd = simulated ? 0x02 : 0x01;
     cmd |= chMask << 8;
-    send((uint8_t*)&cmd, sizeof(cmd));
 
-    packet_size = getPacketSize();
+    sr_cmd = sr;
+    live_cmd = cmd;
+}
 
-    if(sample_rate > 100){
-        bytes_to_read = !(MAX_BUFFER_SIZE%packet_size) ? MAX_BUFFER_SIZE-packet_size : MAX_BUFFER_SIZE-(MAX_BUFFER_SIZE%packet_size);
-    }else{
-        bytes_to_read = packet_size;
-    }
+/*****************************************************************************/
 
-    if(bytes_to_read % packet_size){
-        printf("Error, bytes_to_read needs to be devisible by packet_size\n");
-        exit(EXIT_FAILURE);
-    }else{
-        num_frames = bytes_to_read/packet_size;
-    }
+// Sends the live mode command prepared by prepareStart(). Without the pause between commands, the caller
+// must make sure the last command was sent long enough ago.
+void ScientISST::goLive(bool pause){
+    send((uint8_t*)&live_cmd, sizeof(live_cmd), pause);
+    live_time = std::chrono::steady_clock::now();
+    arrival_frames = 0;
+    arrival_start = live_time;
+    arrival_rate = 0;
+}
+
+/*****************************************************************************/
 
-    frames.resize(num_frames);  // resize the frames vector with num_frames frames
+// Last part of start(): opens the capture, the file and the sinks once the device is in live mode.
+void ScientISST::openOutputs(const char *file_name){
+    if(!capture_name.empty()){
+        CaptureHeader header;
+        header.api_mode = api_mode;
+        header.sr_cmd = sr_cmd;
+        header.live_cmd = live_cmd;
+        header.firmware_version = firmware_version;
+        header.adc_chars = adc1_chars;
+        if(!capture_file.open(capture_name.c_str(), header)){
+            printf("Capture file cannot be opened.");
+            exit(-1);
+        }
+    }
 
     //Open file and write header
-    initFile(file_name);
+    delete file_sink;
+    file_sink = (file_name != NULL) ? new CsvSink(file_name) : NULL;
+    if(file_sink)   file_sink->open(block);
+    try{
+        for(size_t i = 0; i < sinks.size(); i++)
+            sinks[i]->open(block);
+    }catch(Exception&){
+        stop();
+        throw;
+    }
 }
 
 /*****************************************************************************/
 
 void ScientISST::stop(void){
-    uint8_t buffer[10];
     uint8_t cmd;
 
     if (num_chs == 0)   throw Exception(Exception::DEVICE_NOT_IN_ACQUISITION);
@@ -647,22 +570,26 @@ void ScientISST::stop(void){
     sample_rate = 0;
 
     //Cleanup existing data in bluetooth socket
-    while(recv(buffer, 1) == 1);
-
-    fclose(output_fd);
+    flush();
+    link->setReadSize(1, 1);
+
+    capture_file.close();
+    if(file_sink){
+        file_sink->close();
+        delete file_sink;
+        file_sink = NULL;
+    }
+    for(size_t i = 0; i < sinks.size(); i++)
+        sinks[i]->close();
 }
 
 /*****************************************************************************/
 
 int ScientISST::read(){
-    unsigned char rcv_buff[1*1000*1000];
-    unsigned char *buffer;
-    int mid_frame_flag = 0;
-    rapidjson::Document d;
-    char memb_name[50];
-    int curr_ch;
-    char* junk;
-    int byte_it = 0;
+    unsigned char *rcv_buff = &rcv_buffer[0];
+    const unsigned char *buffer;
+    unsigned char *end;
+    int num_frames = 0;
 
     if(num_chs == 0)   throw Exception(Exception::DEVICE_NOT_IN_ACQUISITION);
 
@@ -671,76 +598,238 @@ int ScientISST::read(){
         return -1;
     }
 
-    recv(rcv_buff, bytes_to_read);
-
+    //A short read means the link was lost and resumed, only the frames received before the loss are decoded
+    METRIC_START(recv_start);
+    end = rcv_buff + recv(rcv_buff, bytes_to_read);
+    METRIC_STOP(metrics, RECV, recv_start);
     buffer = rcv_buff;
-    for(VFrame::iterator it = frames.begin(); it != frames.end(); it++){
-        
-        
-        if(!checkCRC4(buffer, packet_size)){
-            printf("checkCRC4 ERROR\n");
-        }
-        while (!checkCRC4(buffer, packet_size)){  // if CRC check failed, try to resynchronize with the next valid frame
-            // checking with one new byte at a time
-            memmove(buffer, buffer+1, packet_size-1);
-            if (recv(buffer+packet_size-1, 1) != 1)    return int(it - frames.begin());   // a timeout has occurred
+
+    while(1){
+        num_frames += decodePackets(buffer, end, num_frames);
+        if(num_frames == (int)frames.size() || gap_ms >= 0)   break;    //The rest of the block was lost with the link
+
+        //Bytes skipped while resynchronizing are made up for at the end of the buffer
+        int missing = packet_size-(end-buffer);
+        if(end+missing > rcv_buff+rcv_buffer.size()){
+            memmove(rcv_buff, buffer, end-buffer);
+            end -= buffer-rcv_buff;
+            buffer = rcv_buff;
         }
+        int got = recv(end, missing);
+        end += got;
+        if(got != missing)   break;    //The link was lost and resumed
+    }
+
+    processBlock(num_frames);
+
+    return num_frames;
+}
+
+/*****************************************************************************/
+
+// Decodes the whole packets in [buffer, end) into frames and block, from frame first_frame on, until the
+// block is full. Advances buffer past the consumed bytes, so fewer than packet_size bytes are left when the
+// block is not full. Returns the number of frames decoded.
+int ScientISST::decodePackets(const unsigned char *&buffer, const unsigned char *end, int first_frame){
+    int num_frames = first_frame;
 
-        Frame &f = *it;
-
-        if(api_mode == API_MODE_SCIENTISST){
-            byte_it = 0;
-
-            //Get seq number and IO states
-            f.seq = buffer[packet_size-1] >> 4;
-            for(int i = 0; i < 4; i++)
-                f.digital[i] = ((buffer[packet_size-2] & (0x80 >> i)) != 0);
-
-            //Get channel values
-            for(int i = 0; i < num_chs; i++){
-                curr_ch = chs[num_chs-1-i];
-
-                //printf("%d\n", *(uint16_t*)(buffer+0) & 0xFFF);
-                
-                //If it's an AX channel
-                if(curr_ch == AX1 || curr_ch == AX2){
-                    f.a[curr_ch] = *(uint32_t*)(buffer+byte_it) & 0xFFFFFF;
-                    byte_it += 3;
-
-                //If it's an AI channel
-                }else{
-                    if(!mid_frame_flag){
-                        f.a[curr_ch] = *(uint16_t*)(buffer+byte_it) & 0xFFF;
-                        byte_it++;
-                        mid_frame_flag = 1;
-                    }else{
-                        f.a[curr_ch] = *(uint16_t*)(buffer+byte_it) >> 4;
-                        byte_it += 2;
-                        mid_frame_flag = 0;
-                    }
-                }
+    METRIC_START(decode_start);
+#ifdef HASMETRICS
+    uint64_t crc_ns = 0;
+#endif
+    while(num_frames < (int)frames.size() && end-buffer >= packet_size){
+        METRIC_START(crc_start);
+        const bool crc_ok = checkCRC4(buffer, packet_size);
+#ifdef HASMETRICS
+        crc_ns += Metrics::now()-crc_start;
+#endif
+        if(!crc_ok){  // if CRC check failed, try to resynchronize with the next valid frame
+            METRIC_ADD(metrics, CRC_FAILURES, 1);
+            if(!resyncing){
+                printf("checkCRC4 ERROR\n");
+                METRIC_ADD(metrics, RESYNCS, 1);
+                resyncing = true;
             }
-            mid_frame_flag = 0;
-        }else if(api_mode == API_MODE_JSON){
-            d.Parse((const char*)buffer);
+            buffer++;   // checking with one new byte at a time
+            continue;
+        }
+        resyncing = false;
+
+        Frame &f = frames[num_frames];
+        decodeFrame(buffer, f);
 
-            f.seq = 1;
+        block.seq[num_frames] = f.seq;
+        block.digital[num_frames] = (f.digital[0] << 3) | (f.digital[1] << 2) | (f.digital[2] << 1) | f.digital[3];
+        for(int i = 0; i < num_chs; i++)
+            block.rawCh(i)[num_frames] = f.a[chs[i]];
+
+        buffer += packet_size;
+        num_frames++;
+    }
+    METRIC_STOP(metrics, DECODE, decode_start);
+#ifdef HASMETRICS
+    metrics.record(Metrics::CRC, crc_ns);
+#endif
+
+    return num_frames-first_frame;
+}
+
+/*****************************************************************************/
+
+// Completes the block of the first num_frames decoded frames: converts, updates the statistics, filters
+// and hands it to the sinks, marking a pending link loss after it.
+void ScientISST::processBlock(int num_frames){
+    METRIC_ADD(metrics, FRAMES, num_frames);
+
+    block.num_frames = num_frames;
+    block.sample_rate = sample_rate;
+
+    METRIC_START(convert_start);
+    for(int i = 0; i < num_chs; i++){
+        const int32_t *raw = block.rawCh(i);
+        int32_t *mv = block.mvCh(i);
+        for(int n = 0; n < num_frames; n++)
+            mv[n] = channelValue(chs[i], raw[n]);
+    }
+    METRIC_STOP(metrics, CONVERT, convert_start);
+
+    statistics.update(block);
+
+    if(dsp.enabled()){
+        METRIC_START(filter_start);
+        dsp.process(block);
+        METRIC_STOP(metrics, FILTER, filter_start);
+    }
+
+    //Decimating by more than the frames of a block leaves some blocks without any frame
+    if(block.num_frames > 0){
+        METRIC_START(write_start);
+        if(file_sink)   file_sink->write(block);
+        for(size_t i = 0; i < sinks.size(); i++)
+            sinks[i]->write(block);
+        METRIC_STOP(metrics, WRITE, write_start);
+    }
+
+    if(block_ms > 0)   adaptBlockSize(num_frames);
+
+    if(gap_ms >= 0){
+        const int missing_frames = (int)(gap_ms*block.sample_rate/1000);     //At the rate of the block, after decimation
+        if(file_sink)   file_sink->gap(gap_ms, missing_frames);
+        for(size_t i = 0; i < sinks.size(); i++)
+            sinks[i]->gap(gap_ms, missing_frames);
+        gap_ms = -1;
+    }
+}
+
+/*****************************************************************************/
+
+// Measures the arrival rate of the frames and resizes the next blocks so they span block_ms,
+// within the capacity allocated by start().
+void ScientISST::adaptBlockSize(int num_frames){
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    //The time the link was lost says nothing about the rate of the device, the window starts over
+    if(gap_ms >= 0){
+        arrival_frames = 0;
+        arrival_start = now;
+        return;
+    }
 
-            for(int i = 1; i < num_chs+1; i++){
+    arrival_frames += num_frames;
+    const double elapsed_s = std::chrono::duration<double>(now - arrival_start).count();
+    if(elapsed_s*1000 < ARRIVAL_WINDOW_MS)   return;
+
+    const double rate = arrival_frames/elapsed_s;
+    arrival_rate = (arrival_rate > 0) ? 0.5*arrival_rate + 0.5*rate : rate;
+    arrival_frames = 0;
+    arrival_start = now;
+
+    const int size = std::max(1, std::min((int)(arrival_rate*block_ms/1000 + 0.5), block.capacity));
+    if(size != (int)frames.size()){
+        frames.resize(size);
+        bytes_to_read = size*packet_size;
+    }
+}
+
+/*****************************************************************************/
+
+void ScientISST::decodeFrame(const unsigned char *buffer, Frame &f){
+    if(api_mode == API_MODE_SCIENTISST){
+        uint8_t seq, digital;
+        int32_t raw[AX2+1];
+
+        decodePacket(buffer, packet_size, chs, num_chs, seq, digital, raw, 1);
+        f.seq = seq;
+        for(int i = 0; i < 4; i++)
+            f.digital[i] = ((digital & (0x08 >> i)) != 0);
+        for(int i = 0; i < num_chs; i++)
+            f.a[chs[i]] = raw[i];
+    }else if(api_mode == API_MODE_JSON){
+        //The document and its parse stack are kept in the arenas of this device, parsing a frame allocates nothing
+        rapidjson::MemoryPoolAllocator<> values(json_values, sizeof(json_values));
+        rapidjson::MemoryPoolAllocator<> stack(json_stack, sizeof(json_stack));
+        rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>, rapidjson::MemoryPoolAllocator<> >
+            d(&values, JSON_STACK_CAPACITY, &stack);
+        char memb_name[50];
+        char* junk;
+
+        d.Parse((const char*)buffer);
+
+        f.seq = 1;
+
+        for(int i = 0; i < num_chs; i++){
+            if(chs[i] == AX1 || chs[i] == AX2){
+                sprintf(memb_name, "AX%d", chs[i]-6);
+            }else{
                 sprintf(memb_name, "AI%d", chs[i]);
-                f.a[i] = strtol(d[memb_name].GetString(), &junk, 10);
             }
-
-            f.digital[0] = strtol(d["I1"].GetString(), &junk, 10);
-            f.digital[1] = strtol(d["I2"].GetString(), &junk, 10);
-            f.digital[2] = strtol(d["O1"].GetString(), &junk, 10);
-            f.digital[3] = strtol(d["O2"].GetString(), &junk, 10);
+            f.a[chs[i]] = strtol(d[memb_name].GetString(), &junk, 10);
         }
-        //printf("%d\n", f.a[0]);
-        writeFrameFile(output_fd, f);
+
+        f.digital[0] = strtol(d["I1"].GetString(), &junk, 10);
+        f.digital[1] = strtol(d["I2"].GetString(), &junk, 10);
+        f.digital[2] = strtol(d["O1"].GetString(), &junk, 10);
+        f.digital[3] = strtol(d["O2"].GetString(), &junk, 10);
     }
+}
+
+/*****************************************************************************/
+
+void ScientISST::filter(const DspConfig &config){
+    if (num_chs != 0)   throw Exception(Exception::DEVICE_NOT_IDLE);
+
+    dsp_config = config;
+}
+
+/*****************************************************************************/
+
+void ScientISST::addSink(Sink *sink){
+    if (num_chs != 0)   throw Exception(Exception::DEVICE_NOT_IDLE);
+    if (sink == NULL)   throw Exception(Exception::INVALID_PARAMETER);
+
+    sinks.push_back(sink);
+}
+
+/*****************************************************************************/
+
+void ScientISST::capture(const char *file_name){
+    if (num_chs != 0)   throw Exception(Exception::DEVICE_NOT_IDLE);
+
+    capture_name = file_name ? file_name : "";
+}
+
+/*****************************************************************************/
+
+void ScientISST::clearSinks(void){
+    if (num_chs != 0)   throw Exception(Exception::DEVICE_NOT_IDLE);
+
+    sinks.clear();
+}
+
+/*****************************************************************************/
 
-    return (int) frames.size();
+ScientISST::VChannelStats ScientISST::stats(void){
+    return statistics.snapshot();
 }
 
 /*****************************************************************************/
@@ -759,10 +848,16 @@ void ScientISST::battery(int value){
 /*****************************************************************************/
 
 void ScientISST::trigger(const Vbool &digitalOutput){
+    setOutputs(digitalOutput, true);
+}
+
+/*****************************************************************************/
+
+void ScientISST::setOutputs(const Vbool &digitalOutput, bool pause){
    unsigned char cmd;
    const size_t len = digitalOutput.size();
 
-   if(len != 2) throw Exception(Exception::INVALID_PARAMETER);
+   if(len != 0 && len != 2) throw Exception(Exception::INVALID_PARAMETER);    //Empty sets all outputs low
 
    cmd = 0xB3;          // 1  0  1  1  O2 O1 1  1 - Set digital outputs
 
@@ -771,12 +866,18 @@ void ScientISST::trigger(const Vbool &digitalOutput){
             cmd |= (0b100 << i);
         }
     }
-   send(&cmd, 1);
+   send(&cmd, 1, pause);
 }
 
 /*****************************************************************************/
 
 void ScientISST::dac(int pwmOutput){
+    setDac(pwmOutput, true);
+}
+
+/*****************************************************************************/
+
+void ScientISST::setDac(int pwmOutput, bool pause){
     uint16_t cmd;
 
     if (pwmOutput < 0 || pwmOutput > 255)   throw Exception(Exception::INVALID_PARAMETER);
@@ -784,7 +885,7 @@ void ScientISST::dac(int pwmOutput){
     cmd = 0xA3;             // 1  0  1  0  0  0  1  1 - Set dac output
 
     cmd |= pwmOutput << 8;
-    send((uint8_t*)&cmd, 2);    
+    send((uint8_t*)&cmd, 2, pause);
 }
 
 /*****************************************************************************/
@@ -868,10 +969,10 @@ const char* ScientISST::Exception::getDescription(void)
 
 /*****************************************************************************/
 
-void ScientISST::send(uint8_t* data, int len){
+void ScientISST::send(uint8_t* data, int len, bool pause){
     uint8_t buff[CMD_MAX_BYTES];
 
-    Sleep(150);
+    if(pause)   Sleep(CMD_PAUSE_MS);
 
     if(len > CMD_MAX_BYTES){
         printf("Error, trying to send a command (%d bytes) bigger than max allowed (%d bytes)\n", len, CMD_MAX_BYTES);
@@ -881,188 +982,141 @@ void ScientISST::send(uint8_t* data, int len){
     memcpy(buff, data, len);
 
     //It is important to always send a fixed amount of bytes with sockets
-    if(com_mode == COM_MODE_TCP_SV || com_mode == COM_MODE_TCP_CL || com_mode == COM_MODE_UDP){
+    if(link->fixed_commands){
         len = CMD_MAX_BYTES;
     }
 
-#ifdef _WIN32
-    if (fd == INVALID_SOCKET)
-    {
-        DWORD nbytwritten = 0;
-        if (!WriteFile(hCom, buff, len, &nbytwritten, NULL))
-            throw Exception(Exception::CONTACTING_DEVICE);
-
-        if (nbytwritten != len)
-            throw Exception(Exception::CONTACTING_DEVICE);
-    }
-    else{
-        if (::send(fd, buff, len, 0) != len)
-            throw Exception(Exception::CONTACTING_DEVICE);
-    }
-
-   
-#else // Linux or Mac OS
-
-    if(com_mode != COM_MODE_UDP){
-        if(write(fd, buff, len) != len){
-            throw Exception(Exception::CONTACTING_DEVICE);
-        }
-    }else{
-        if (sendto(fd, buff, len, 0, (const struct sockaddr *) (&client_addr), client_addr_len) == -1) {
-            perror("ERROR: sendto");
-        }
-    }
-
-#endif
+    if(!link->send(buff, len))
+        throw Exception(Exception::CONTACTING_DEVICE);
 }
 
 /*****************************************************************************/
 
 int ScientISST::recv(void *data, int nbyttoread, uint8_t is_datagram){
     int bytes_read = 0;
-#ifdef _WIN32
-   if (fd == INVALID_SOCKET)
-   {
-      for(int n = 0; n < nbyttoread;)
-      {
-         DWORD nbytread = 0;
-	      if (!ReadFile(hCom, (char *) data+n, nbyttoread-n, &nbytread, NULL))
- 		      throw Exception(Exception::CONTACTING_DEVICE);
-
-         if (nbytread == 0)
-         {
-            DWORD stat;
-            if (!GetCommModemStatus(hCom, &stat) || !(stat & MS_DSR_ON))
-               throw Exception(Exception::CONTACTING_DEVICE);  // connection is lost
-
-            return ESP_STOP_LIVE_MODE;   // a timeout occurred
-         }
-
-         n += nbytread;
-      }
-
-	   return nbyttoread;
-   }
-#endif
-
-#ifndef _WIN32 // Linux or Mac OS
-   timeval  readtimeout;
-   readtimeout.tv_sec = 4;
-   readtimeout.tv_usec = 0;
-#endif
-
-    fd_set   readfds;
-    FD_ZERO(&readfds);
-    FD_SET(fd, &readfds);
 
     while(bytes_read < nbyttoread){
-        int state = select(FD_SETSIZE, &readfds, NULL, NULL, &readtimeout);
-        if(state < 0){
-            throw Exception(Exception::CONTACTING_DEVICE);
-        }
+        int ret = link->recv((char *)data+bytes_read, nbyttoread-bytes_read, RECV_TIMEOUT_MS);
 
-        if (state == 0){
-            printf("recv: Error, a timeout occured\n");
-            throw Exception(Exception::CONTACTING_DEVICE);
-        }
+        if(ret > 0){
+            if(capture_file.isOpen())   capture_file.write((char *)data+bytes_read, ret);
+            bytes_read += ret;
+            METRIC_ADD(metrics, BYTES, ret);
 
-        ssize_t ret = ::read(fd, (char *)data+bytes_read, nbyttoread-bytes_read);
+            //If it is a datagram, stop reading
+            if(is_datagram){
+                break;
+            }
+            continue;
+        }
 
-        if(ret <= 0){
+        if(ret < 0){
             printf("ScientISST did not send all bytes it was supposed to send. Recieved %d/%d (bytes)\n", bytes_read, nbyttoread);
-            throw Exception(Exception::CONTACTING_DEVICE);
+        }else{
+            printf("recv: Error, a timeout occured\n");
+            METRIC_ADD(metrics, TIMEOUTS, 1);
         }
-        
-        bytes_read += ret;
 
-        //If it is a datagram, stop reading
-        if(is_datagram){
-            break;
+        //The link is lost, or the device went silent during an acquisition. When idle a timeout only means a
+        //reply didn't come, so the link is left alone. After a reconnect in acquisition return a short read,
+        //in idle the command that was interrupted is lost anyway.
+        if(supervised && (ret != 0 || num_chs != 0) && reconnect() && num_chs != 0){
+            return bytes_read;
         }
+        throw Exception(Exception::CONTACTING_DEVICE);
     }
 
-    //return nbyttoread;
     return bytes_read;
 }
 
 /*****************************************************************************/
 
-void ScientISST::close(void){
-#ifdef _WIN32
-    if (fd == INVALID_SOCKET)
-        CloseHandle(hCom);
-    else
-    {
-        closesocket(fd);
-        WSACleanup();
-    }
-   
-#else // Linux or Mac OS
-
-    ::close(fd);
-
-#endif
+// Discards everything still arriving from the device, returning once the link has been silent for FLUSH_TIMEOUT_MS.
+// Unlike recv(), a silent link is the expected outcome here and is not reported as an error.
+void ScientISST::flush(void){
+    link->flush(FLUSH_TIMEOUT_MS);
 }
 
 /*****************************************************************************/
 
-void ScientISST::initFile(const char* file_name){
-    output_fd = fopen(file_name, "w");
-    if(output_fd == NULL){
-        printf("Output file cannot be opened.");
-        exit(-1);
-    }
+// Re-establishes a lost link with exponential backoff and, if an acquisition was running, replays the
+// start() configuration so the device is back in live mode. The outage is left in gap_ms for read() to mark.
+bool ScientISST::reconnect(void){
+    uint8_t api;
+    int interval = RECONNECT_INTERVAL_MS;
+    std::chrono::steady_clock::time_point lost = std::chrono::steady_clock::now();
 
-    fprintf(output_fd, "NSeq, I1, I2, O1, O2, ");
-    for(int i = 0; i < num_chs; i++){
+    if(!link->canReconnect())   return false;
 
-        if(chs[i] == AX1 || chs[i] == AX2){
-            if(i == num_chs-1){
-                fprintf(output_fd, "AX%d", chs[i]-6);
-            }else{
-                fprintf(output_fd, "AX%d, ", chs[i]-6);
-            }
-        }else{
-            if(i == num_chs-1){
-                fprintf(output_fd, "AI%d [raw], AI%d [mV]", chs[i], chs[i]);
-            }else{
-                fprintf(output_fd, "AI%d [raw], AI%d [mV], ", chs[i], chs[i]);
+    for(int attempt = 1; attempt <= RECONNECT_ATTEMPTS; attempt++){
+        printf("Connection lost, reconnecting (attempt %d/%d)\n", attempt, RECONNECT_ATTEMPTS);
+
+        if(link->reconnect()){
+            if(num_chs != 0){
+                api = (api_mode << 4) | 0b11;
+                send(&api, 1);
+                send((uint8_t*)&sr_cmd, sizeof(sr_cmd));
+                send((uint8_t*)&live_cmd, sizeof(live_cmd));
+
+                gap_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lost).count();
             }
+            printf("Connection restored\n");
+            METRIC_ADD(metrics, RECONNECTS, 1);
+            return true;
         }
-        
+
+        Sleep(interval);
+        interval = std::min(2*interval, RECONNECT_MAX_INTERVAL_MS);
     }
-    fprintf(output_fd, "\n");
+
+    return false;
+}
+
+/*****************************************************************************/
+
+void ScientISST::blockDuration(int ms){
+    if (num_chs != 0)   throw Exception(Exception::DEVICE_NOT_IDLE);
+    if (ms < 0)   throw Exception(Exception::INVALID_PARAMETER);
+
+    block_ms = ms;
 }
 
-#define VOLT_DIVIDER_FACTOR 3.399
+/*****************************************************************************/
+
+void ScientISST::supervise(bool enable){
+    if (enable && !link->canReconnect())   throw Exception(Exception::NOT_SUPPORTED);
 
-void ScientISST::writeFrameFile(FILE* fd, Frame f){
-    int channel_value_mV;
+    supervised = enable;
+}
 
-    fprintf(fd, "%d, %d, %d, %d, %d, ", f.seq, f.digital[0], f.digital[1], f.digital[2], f.digital[3]);
+/*****************************************************************************/
+
+// Converts a raw value to mV for AI channels, or sign extends it for the 24 bit AX channels
+int32_t ScientISST::channelValue(int ch, uint32_t raw){
+    return rawToValue(ch, raw, &adc1_chars);
+}
+
+void ScientISST::writeFrameFile(FILE* fd, const Frame &f){
+    char line[CSV_MAX_LINE_START + (AX2+1)*2*(CSV_MAX_INT_CHARS+2)];
+    char *p = line;
+
+    //Same line as CsvSink, formatted without printf
+    p = CsvSink::appendInt(p, f.seq);
+    for(int i = 0; i < 4; i++){
+        *p++ = ','; *p++ = ' ';
+        *p++ = f.digital[i] ? '1' : '0';
+    }
 
     for(int i = 0; i < num_chs; i++){
-        if(chs[i] == AX1 || chs[i] == AX2){
-            int32_t aux;
-            aux = (int32_t)f.a[chs[i]] << 8;
-            aux = aux >> 8;
-            channel_value_mV = aux;
-        }else{
-            channel_value_mV = esp_adc_cal_raw_to_voltage(f.a[chs[i]], &adc1_chars)*VOLT_DIVIDER_FACTOR;
-        }
-        
-        
-        
-        if(i == num_chs-1){ 
-            fprintf(fd, "%d, %d", f.a[chs[i]], channel_value_mV);
-        }else{
-            fprintf(fd, "%d, %d, ", f.a[chs[i]], channel_value_mV);
-        }
-        /*if(i == num_chs-1){ 
-            fprintf(fd, "%d", f.a[chs[i]]);
-        }else{
-            fprintf(fd, "%d, ", f.a[chs[i]]);
-        }*/
+        *p++ = ','; *p++ = ' ';
+        p = CsvSink::appendInt(p, f.a[chs[i]]);
+        *p++ = ','; *p++ = ' ';
+        p = CsvSink::appendInt(p, channelValue(chs[i], f.a[chs[i]]));
     }
-    fprintf(fd, "\n");
+    if(num_chs == 0){
+        *p++ = ','; *p++ = ' ';
+    }
+    *p++ = '\n';
+
+    fwrite(line, 1, p-line, fd);
 }
@@ -2,6 +2,7 @@
 #ifndef _SCIENTISST_H
 #define _SCIENTISST_H
 
+#include <chrono>
 #include <string>
 #include <vector>
 #include <arpa/inet.h>
@@ -11,6 +12,13 @@
 #include <unistd.h>
 #include <netdb.h>
 #include "esp_adc.h"
+#include "block.h"
+#include "dsp.h"
+#include "stats.h"
+#include "metrics.h"
+#include "sink.h"
+#include "replay.h"
+#include "transport.h"
 
 #ifdef _WIN32 // 32-bit or 64-bit Windows
 
@@ -23,14 +31,26 @@
 #define API_MODE_SCIENTISST 2
 #define API_MODE_JSON 3
 
-#define COM_MODE_BT     0
-#define COM_MODE_UART   1
-#define COM_MODE_TCP_SV 2
-#define COM_MODE_TCP_CL 3
-#define COM_MODE_UDP    4
+#define ADC_CACHE_OFF       0   //Always ask the device for its version and adc characteristics
+#define ADC_CACHE_ON        1   //Use the characteristics received on this connection or cached on disk
+#define ADC_CACHE_VALIDATE  2   //Ask the device once per connection, refreshing the disk cache
 
+#define CMD_PAUSE_MS    150                         //Pause before each command, so the device has handled the previous one
 #define CMD_MAX_BYTES   4                           //Max byte size of a command (currently it's the set sample rate command, which is 3 bytes)
 #define MAX_BUFFER_SIZE (5744)
+#define MAX_BLOCK_BYTES (1*1000*1000)               //Bytes a single read() can buffer, bounds the blocks of blockDuration()
+#define ARRIVAL_WINDOW_MS 1000                      //Time over which the arrival rate is measured to resize the blocks
+#define JSON_ARENA_BYTES 4096                       //Memory for parsing a JSON frame, rapidjson falls back to the heap beyond it
+#define JSON_STACK_CAPACITY 1024                    //Initial parse stack of a JSON frame, grows within its arena
+#define FLUSH_TIMEOUT_MS 500                        //Silence on the link after which pending data is considered flushed
+#define RECV_TIMEOUT_MS  4000                       //Silence after which a read from the link gives up
+
+#define DISCOVERY_THREADS           8               //Parallel remote name requests in ScientISST::find()
+#define DISCOVERY_NAME_TIMEOUT_MS   5000
+
+#define RECONNECT_ATTEMPTS          10
+#define RECONNECT_INTERVAL_MS       250             //Wait after the first failed reconnect attempt, doubled after each one
+#define RECONNECT_MAX_INTERVAL_MS   5000
 
 #define AI1 1
 #define AI2 2
@@ -55,6 +75,7 @@ public:
     {
         std::string macAddr; ///< MAC address of a Bluetooth device
         std::string name;    ///< Name of a Bluetooth device
+        std::string firmware; ///< Firmware version of a Bluetooth device, empty if it was never connected
     };
     typedef std::vector<DevInfo> VDevInfo; ///< Vector of DevInfo's.
 
@@ -71,10 +92,13 @@ public:
         bool  digital[4]; 
 
         
-        uint32_t a[8]; /// Array of analog inputs values of the 8 channles (6 AIs and 2 AXs))
+        uint32_t a[AX2+1]; ///< Array of analog inputs values indexed by channel, AI1...AX2 (a[0] is unused)
     };
     typedef std::vector<Frame> VFrame;  ///< Vector of Frame's.
 
+    typedef ::ChannelStats ChannelStats;    ///< Signal quality statistics of a channel returned by ScientISST::stats()
+    typedef ::VChannelStats VChannelStats;  ///< Vector of ChannelStats.
+
     /// Current device state returned by ScientISST::state()
     struct State
     {
@@ -112,17 +136,38 @@ public:
     // Static methods
 
     /** Searches for Bluetooth devices in range.
+        * Names of devices already in the inventory are taken from it, the others are resolved in parallel.
+        * The found devices are added to the inventory.
         * \return a list of found devices
         * \exception Exception (Exception::PORT_INITIALIZATION)
         * \exception Exception (Exception::BT_ADAPTER_NOT_FOUND)
         */
     static VDevInfo find(void);
 
+    /** Lists the devices in the inventory, without any Bluetooth activity.
+        * The inventory is kept on disk and holds every device found by find() or connected to over Bluetooth.
+        * \return a list of known devices
+        */
+    static VDevInfo known(void);
+
+    /** Serves the acquisition metrics of all devices of the process in the Prometheus text format, over HTTP
+        * from a background thread: byte, frame, CRC failure, resync, timeout and reconnect counters, and latency
+        * histograms of receiving, CRC checking, decoding, converting, filtering and writing each block.
+        * The metrics are only collected if the library was built with HASMETRICS defined.
+        * \param[in] address A Unix socket ("unix:/path") or a loopback TCP port ("127.0.0.1:9100" or "9100")
+        * \exception Exception (Exception::PORT_COULD_NOT_BE_OPENED)
+        */
+    static void serveMetrics(const char *address);
+
     // Instance methods
 
     /** Connects to a %ScientISST device.
-        * \param[in] address The device Bluetooth MAC address ("xx:xx:xx:xx:xx:xx")
-        * or a serial port ("COMx" on Windows or "/dev/..." on Linux or Mac OS X)
+        * \param[in] address The device Bluetooth MAC address ("xx:xx:xx:xx:xx:xx") or name, if it is in the inventory,
+        * or a serial port ("COMx" on Windows or "/dev/..." on Linux or Mac OS X), optionally with its baud rate
+        * ("/dev/ttyUSB0:921600", 115200 if not given)
+        * or a network endpoint ("server_tcp:<port>", "server_udp:<port>" or "client_tcp:<host>:<port>")
+        * or a capture written by capture(), played back as a device ("replay:<file>" at the speed it was recorded,
+        * "replay:<file>@<factor>" at factor times that speed or "replay:<file>@max" as fast as it is read) - Linux or Mac OS only
         * \exception Exception (Exception::PORT_COULD_NOT_BE_OPENED)
         * \exception Exception (Exception::PORT_INITIALIZATION)
         * \exception Exception (Exception::INVALID_ADDRESS)
@@ -130,27 +175,46 @@ public:
         * \exception Exception (Exception::DEVICE_NOT_FOUND) - Windows only
         */
     ScientISST(const char *address);
+
+    /** Uses a link opened by the caller, such as a LoopbackTransport whose device end is simulated in-process.
+        * \param[in] _link The link to the device, owned by the object from now on
+        * \param[in] label Name of the device in the metrics
+        */
+    ScientISST(Transport *_link, const char *label = "loopback");
     
     /// Disconnects from a %ScientISST device. If an aquisition is running, it is stopped. 
     ~ScientISST();
 
     /** Gets the device firmware version string and the adc characteristics.
+        * The result is cached in memory and, for devices identified by their Bluetooth MAC address, in the
+        * inventory, so start() can skip this round trip. A serial port or a network address may lead to another
+        * board from one session to the next, their characteristics are asked on the first start() of each connection.
+        * See cacheAdcChars().
         * \remarks This method cannot be called during an acquisition.
         * \exception Exception (Exception::DEVICE_NOT_IDLE)
         * \exception Exception (Exception::CONTACTING_DEVICE)
         */
     void versionAndAdcChars(void);
     
+    /** Selects how start() gets the firmware version and adc characteristics.
+        * \param[in] mode ADC_CACHE_ON (default) uses the characteristics already received on this connection or
+        * cached on disk for a Bluetooth MAC address, ADC_CACHE_VALIDATE asks the device on the first start() of the connection and refreshes
+        * the disk cache, ADC_CACHE_OFF asks the device on every start().
+        * \exception Exception (Exception::INVALID_PARAMETER)
+        */
+    void cacheAdcChars(int mode = ADC_CACHE_ON);
+
     /** Starts a signal acquisition from the device.
         * \param[in] samplingRate Sampling rate in Hz. Accepted values are 1, 10, 100 or 1000 Hz. Default value is 1000 Hz.
         * \param[in] channels Set of channels to acquire. Accepted channels are 1...6 for inputs A1...A6.
         * If this set is empty or if it is not given, all 8 analog channels will be acquired.
-        * \param[in] file_name Name of the file where the live mode data will be written into.
+        * \param[in] file_name Name of the CSV file where the live mode data will be written into. If NULL, no file is
+        * written and the data only goes to ScientISST::block and to the sinks added with addSink().
         * \param[in] simulated If true, start in simulated mode. Otherwise start in live mode. Default is to start in live mode.
         * \param[in] api The API mode, this API supports the ScientISST and JSON APIs.
         * \remarks This method cannot be called during an acquisition.
         * \exception Exception (Exception::DEVICE_NOT_IDLE)
-        * \exception Exception (Exception::INVALID_PARAMETER)
+        * \exception Exception (Exception::INVALID_PARAMETER) - also if a sink rejects the channels, the acquisition is then stopped
         * \exception Exception (Exception::CONTACTING_DEVICE)
         */
     void start(int _sample_rate = 1000, const Vint &channels = Vint(), const char* file_name = "output.csv",  bool simulated = false, int api = API_MODE_SCIENTISST);
@@ -162,16 +226,63 @@ public:
         */
     void stop(void);
     
-    /** Reads acquisition frames from the device.
-        * This method returns when all requested frames are received from the device, or when 5-second receive timeout occurs.
-        * \param[out] frames Vector of frames to be filled. If the vector is empty, it is resized to 100 frames.
-        * \return Number of frames returned in frames vector. If a timeout occurred, this number is less than the frames vector size.
+    /** Sets the streaming filters applied to the acquired data, from the next start() on.
+        * The filters run on the mV values (sign extended values for AX channels) of every channel.
+        * When decimating, the output file and ScientISST::block hold the decimated frames, which
+        * keep the raw values, sequence number and digital ports of the frame they were taken at.
+        * The decimation may exceed the frames of a block: ScientISST::block is then empty after some reads.
+        * ScientISST::frames always holds the frames as received.
+        * \param[in] config Filters to apply. If it is not given, filtering is disabled.
+        * \remarks This method cannot be called during an acquisition.
+        * \exception Exception (Exception::DEVICE_NOT_IDLE)
+        * \exception Exception (Exception::INVALID_PARAMETER) - thrown by start() if a frequency is not below the Nyquist frequency
+        * or the decimation is below 1
+        */
+    void filter(const DspConfig &config = DspConfig());
+
+    /** Adds a sink that receives every block, after filtering, from the next start() on.
+        * The sinks get the blocks after the file given to start(), in the order they were added.
+        * The sink is not owned by the device and must outlive the acquisition.
+        * \remarks This method cannot be called during an acquisition.
+        * \exception Exception (Exception::DEVICE_NOT_IDLE)
+        * \exception Exception (Exception::INVALID_PARAMETER)
+        */
+    void addSink(Sink *sink);
+
+    /** Records the bytes received during the next acquisitions, as they arrive, to a capture file.
+        * The capture can be played back through the whole decode path with the "replay:<file>" address.
+        * The file is created by each start() and closed by stop().
+        * \param[in] file_name Name of the capture file. If NULL, capturing is disabled.
+        * \remarks This method cannot be called during an acquisition.
+        * \exception Exception (Exception::DEVICE_NOT_IDLE)
+        */
+    void capture(const char *file_name);
+
+    /** Removes all sinks added with addSink().
+        * \remarks This method cannot be called during an acquisition.
+        * \exception Exception (Exception::DEVICE_NOT_IDLE)
+        */
+    void clearSinks(void);
+
+    /** Reads the next block of acquisition frames into ScientISST::frames and ScientISST::block, and hands the
+        * block to the output file and the sinks. The block size is set by start() and follows blockDuration().
+        * This method returns when the whole block is received from the device. If nothing arrives for RECV_TIMEOUT_MS
+        * or the link is lost, CONTACTING_DEVICE is thrown, unless the device is supervised (see supervise()).
+        * \return Number of frames received, before any decimation by filter(). In supervised mode, fewer frames than
+        * the block size mean the link was lost and resumed: only the frames received before the loss are returned.
         * \remarks This method must be called only during an acquisition.
         * \exception Exception (Exception::DEVICE_NOT_IN_ACQUISITION)
         * \exception Exception (Exception::CONTACTING_DEVICE)
         */   
     int read();
     
+    /** Returns the signal quality statistics of each acquired channel, in the order given to start().
+        * They are computed incrementally from the unfiltered frames of every read() since start():
+        * mean, variance, minimum and maximum, count of saturated samples, RMS around the mean over the last
+        * STATS_WINDOW_MS (exponential window) and flatline detection. This method can be called from another thread during an acquisition.
+        */
+    VChannelStats stats(void);
+
     /** Sets the battery voltage threshold for the low-battery LED.
         * \param[in] value Battery voltage threshold. Default value is 0.
         * Value | Voltage Threshold
@@ -216,41 +327,95 @@ public:
         */
     State state(void);
 
+    /** Enables or disables the supervised session mode.
+        * In supervised mode a lost link (Bluetooth or TCP client) is detected by read(), the device is reconnected
+        * with exponential backoff and the last start() configuration is replayed, so the acquisition continues
+        * into the same output file. The gap is marked in the file with a line starting with '#'.
+        * Supervised mode is enabled by default for TCP client connections.
+        * \param[in] enable True to enable, false to let read() throw on link loss.
+        * \exception Exception (Exception::NOT_SUPPORTED) - the current link cannot be reconnected
+        */
+    void supervise(bool enable = true);
+
+    /** Sets the time span of the blocks returned by read() and handed to the sinks, for the next acquisitions.
+        * start() sizes the blocks for this duration at the requested sample rate. During the acquisition the
+        * arrival rate of the frames is measured every second and the blocks are resized so that each one still
+        * spans about this duration if the device delivers slower than requested. The blocks never grow beyond
+        * the size set by start(), so no memory is allocated while resizing.
+        * \param[in] ms Duration of a block in milliseconds, e.g. 10 for closed-loop feedback or 1000 for archival.
+        * If 0 (default), blocks are as large as the device buffer above 100 Hz and a single frame otherwise.
+        * \remarks This method cannot be called during an acquisition.
+        * \exception Exception (Exception::DEVICE_NOT_IDLE)
+        * \exception Exception (Exception::INVALID_PARAMETER)
+        */
+    void blockDuration(int ms = 0);
+
     int sample_rate;
-    int bytes_to_read;  //Bytes to read in each read
+    int bytes_to_read;  //Bytes to read in each read, follows the block size set by blockDuration()
     VFrame frames;     
+    Block block;        //Frames of the last read() in structure of arrays layout, after filtering
     std::string firmware_version;
 
     void changeAPI(uint8_t api);
-    void writeFrameFile(FILE* fd, Frame f);
+    void writeFrameFile(FILE* fd, const Frame &f);
 
 private:
-    void send(uint8_t* data, int len);
+    friend class EventLoop;     //Drives the acquisition through decodePackets() and processBlock() instead of read()
+    friend class DeviceGroup;   //Splits start() to send the live mode commands of its devices together
+    friend class OutputScheduler;   //Sends the output commands at their time, without the pause between commands
+
+    void init(const char *label);
+    void send(uint8_t* data, int len, bool pause = true);
+    void prepareStart(int _sample_rate, const Vint &channels, bool simulated, int api);
+    void goLive(bool pause);
+    void openOutputs(const char *file_name);
+    void setOutputs(const Vbool &digitalOutput, bool pause);
+    void setDac(int pwmOutput, bool pause);
     int getPacketSize();
-    void close(void);
+    void decodeFrame(const unsigned char *buffer, Frame &f);
+    int32_t channelValue(int ch, uint32_t raw);
     int recv(void *data, int nbyttoread, uint8_t is_datagram=0);
-    void initFile(const char* file_name);
+    void flush(void);
     void recvAdcConfig(void);
+    bool reconnect(void);
+    bool loadAdcChars(void);
+    int decodePackets(const unsigned char *&buffer, const unsigned char *end, int first_frame);
+    void processBlock(int num_frames);
+    void adaptBlockSize(int num_frames);
 
     int num_chs;
     int packet_size;
     int api_mode;
-    FILE* output_fd;
+    CsvSink *file_sink;         //Sink of the file given to start(), NULL if none
+    std::vector<Sink*> sinks;   //Sinks added with addSink()
+    std::string capture_name;   //File given to capture(), empty if none
+    CaptureWriter capture_file;
     int chs[AX2+1];
     esp_adc_cal_characteristics_t adc1_chars;
-
-    int com_mode;
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len;
-
-#ifdef _WIN32
-    SOCKET	fd;
-    timeval  readtimeout;
-    HANDLE   hCom;
-#else // Linux or Mac OS
-    int      fd;
-    //bool     isTTY;
-#endif
+    std::string device_key;     //Inventory key of the device, empty when the link doesn't identify it (serial port, TCP, UDP)
+    int adc_cache_mode;
+    bool adc_chars_valid;       //adc1_chars and firmware_version hold the characteristics of this connection
+
+    std::vector<unsigned char> rcv_buffer;      //Bytes of a block read by read(), sized by start()
+    alignas(8) char json_values[JSON_ARENA_BYTES];  //Arenas of the JSON frame parser
+    alignas(8) char json_stack[JSON_ARENA_BYTES];
+
+    DspConfig dsp_config;
+    Dsp dsp;
+    Stats statistics;
+    Metrics metrics;
+
+    Transport *link;
+    bool supervised;
+    bool resyncing;         //Bytes are being skipped after a CRC failure, until a valid frame is found
+    int gap_ms;             //Duration of the last link loss not yet marked in the output file, -1 if none
+    int block_ms;           //Duration of a block given to blockDuration(), 0 for the default sizing
+    long arrival_frames;    //Frames received since arrival_start
+    std::chrono::steady_clock::time_point live_time;    //Time the live mode command of the acquisition was sent
+    std::chrono::steady_clock::time_point arrival_start;
+    double arrival_rate;    //Smoothed frames per second measured during the acquisition, 0 until the first window
+    uint32_t sr_cmd;        //Last sample rate and live mode commands sent by start(), replayed after a reconnect
+    uint16_t live_cmd;
 };
 
 #endif
@@ -0,0 +1,255 @@
+#include <cstring>
+#include <new>
+#include "scientisst.h"
+#include "scientisst_c.h"
+
+// Hands the blocks to the callbacks of scientisst_add_sink().
+class CallbackSink : public Sink
+{
+public:
+    CallbackSink(scientisst_block_callback _on_block, scientisst_gap_callback _on_gap, void *_user)
+        : on_block(_on_block), on_gap(_on_gap), user(_user) {}
+
+    virtual void write(const Block &b){
+        scientisst_block block;
+
+        block.num_frames = b.num_frames;
+        block.num_chs = b.num_chs;
+        block.capacity = b.capacity;
+        block.sample_rate = b.sample_rate;
+        block.chs = b.chs;
+        block.seq = b.seq.data();
+        block.digital = b.digital.data();
+        block.raw = b.raw.data();
+        block.mv = b.mv.data();
+        on_block(user, &block);
+    }
+
+    virtual void gap(int gap_ms, int missing_frames){
+        if(on_gap)   on_gap(user, gap_ms, missing_frames);
+    }
+
+private:
+    scientisst_block_callback on_block;
+    scientisst_gap_callback on_gap;
+    void *user;
+};
+
+struct scientisst_device
+{
+    ScientISST *dev;
+    std::vector<CallbackSink*> sinks;
+};
+
+/*****************************************************************************/
+
+// Runs call, turning every exception into a status code.
+template<typename Call> static int guard(Call call){
+    try{
+        call();
+    }catch(ScientISST::Exception &e){
+        return e.code;
+    }catch(ScientISST::Exception::Code code){    //A code thrown without its Exception
+        return code;
+    }catch(std::bad_alloc&){
+        return SCIENTISST_OUT_OF_MEMORY;
+    }catch(...){
+        return SCIENTISST_UNKNOWN_ERROR;
+    }
+    return SCIENTISST_OK;
+}
+
+/*****************************************************************************/
+
+const char* scientisst_strerror(int status){
+    switch(status){
+        case SCIENTISST_OK:
+            return "No error.";
+        case SCIENTISST_OUT_OF_MEMORY:
+            return "Out of memory.";
+        case SCIENTISST_UNKNOWN_ERROR:
+            return "Unknown error.";
+    }
+    if(status < SCIENTISST_INVALID_ADDRESS || status > SCIENTISST_NOT_SUPPORTED)
+        return "Unknown status code.";
+
+    ScientISST::Exception e((ScientISST::Exception::Code)status);
+    return e.getDescription();
+}
+
+/*****************************************************************************/
+
+int scientisst_open(const char *address, scientisst_device **dev){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+    *dev = NULL;
+    if(address == NULL)   return SCIENTISST_INVALID_ADDRESS;
+
+    return guard([&](){
+        scientisst_device *d = new scientisst_device();
+        try{
+            d->dev = new ScientISST(address);
+        }catch(...){
+            delete d;
+            throw;
+        }
+        *dev = d;
+    });
+}
+
+/*****************************************************************************/
+
+void scientisst_close(scientisst_device *dev){
+    if(dev == NULL)   return;
+
+    guard([&](){ delete dev->dev; });       //Stops an acquisition in progress
+    for(size_t i = 0; i < dev->sinks.size(); i++)
+        delete dev->sinks[i];
+    delete dev;
+}
+
+/*****************************************************************************/
+
+int scientisst_version(scientisst_device *dev, char *version, size_t len){
+    if(dev == NULL || version == NULL || len == 0)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){
+        dev->dev->versionAndAdcChars();
+        strncpy(version, dev->dev->firmware_version.c_str(), len-1);
+        version[len-1] = '\0';
+    });
+}
+
+/*****************************************************************************/
+
+int scientisst_start(scientisst_device *dev, int sample_rate, const int *channels, int num_channels,
+                     const char *file, int simulated, int api){
+    if(dev == NULL || num_channels < 0 || (num_channels > 0 && channels == NULL))   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){
+        const ScientISST::Vint chs(channels, channels + num_channels);
+        dev->dev->start(sample_rate, chs, file, simulated != 0, api);
+    });
+}
+
+/*****************************************************************************/
+
+int scientisst_stop(scientisst_device *dev){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){ dev->dev->stop(); });
+}
+
+/*****************************************************************************/
+
+int scientisst_block_capacity(scientisst_device *dev, int *capacity){
+    if(dev == NULL || capacity == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    *capacity = dev->dev->block.capacity;
+    return SCIENTISST_OK;
+}
+
+/*****************************************************************************/
+
+int scientisst_read(scientisst_device *dev, uint8_t *seq, uint8_t *digital, int32_t *raw, int32_t *mv,
+                    int max_frames, int *num_frames){
+    if(dev == NULL || num_frames == NULL)   return SCIENTISST_INVALID_PARAMETER;
+    *num_frames = 0;
+    if(max_frames < dev->dev->block.capacity)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){
+        dev->dev->read();
+
+        const Block &b = dev->dev->block;
+        const int n = b.num_frames;
+        if(seq)       memcpy(seq, b.seq.data(), n);
+        if(digital)   memcpy(digital, b.digital.data(), n);
+        for(int i = 0; i < b.num_chs; i++){
+            if(raw)   memcpy(raw + i*max_frames, b.rawCh(i), n*sizeof(int32_t));
+            if(mv)    memcpy(mv + i*max_frames, b.mvCh(i), n*sizeof(int32_t));
+        }
+        *num_frames = n;
+    });
+}
+
+/*****************************************************************************/
+
+int scientisst_block_duration(scientisst_device *dev, int ms){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){ dev->dev->blockDuration(ms); });
+}
+
+/*****************************************************************************/
+
+int scientisst_add_sink(scientisst_device *dev, scientisst_block_callback on_block, scientisst_gap_callback on_gap, void *user){
+    if(dev == NULL || on_block == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){
+        CallbackSink *sink = new CallbackSink(on_block, on_gap, user);
+        try{
+            dev->dev->addSink(sink);
+            dev->sinks.push_back(sink);
+        }catch(...){
+            delete sink;
+            throw;
+        }
+    });
+}
+
+/*****************************************************************************/
+
+int scientisst_clear_sinks(scientisst_device *dev){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){
+        dev->dev->clearSinks();
+        for(size_t i = 0; i < dev->sinks.size(); i++)
+            delete dev->sinks[i];
+        dev->sinks.clear();
+    });
+}
+
+/*****************************************************************************/
+
+int scientisst_capture(scientisst_device *dev, const char *file){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){ dev->dev->capture(file); });
+}
+
+/*****************************************************************************/
+
+int scientisst_supervise(scientisst_device *dev, int enable){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){ dev->dev->supervise(enable != 0); });
+}
+
+/*****************************************************************************/
+
+int scientisst_battery(scientisst_device *dev, int value){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){ dev->dev->battery(value); });
+}
+
+/*****************************************************************************/
+
+int scientisst_trigger(scientisst_device *dev, const int *outputs, int num_outputs){
+    if(dev == NULL || num_outputs < 0 || (num_outputs > 0 && outputs == NULL))   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){
+        ScientISST::Vbool digital;
+        for(int i = 0; i < num_outputs; i++)
+            digital.push_back(outputs[i] != 0);
+        dev->dev->trigger(digital);
+    });
+}
+
+/*****************************************************************************/
+
+int scientisst_dac(scientisst_device *dev, int value){
+    if(dev == NULL)   return SCIENTISST_INVALID_PARAMETER;
+
+    return guard([&](){ dev->dev->dac(value); });
+}
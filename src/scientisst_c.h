@@ -0,0 +1,107 @@
+#ifndef _SCIENTISST_C_H
+#define _SCIENTISST_C_H
+
+/* C interface of the library, for services written in C or in languages with a C FFI.
+ * No C++ exception crosses it: every function returns a scientisst_status, SCIENTISST_OK on success.
+ * A device handle must not be used by two threads at the same time. Built as libscientisst.so by "make lib".
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Status codes, the library exception codes keep their values (see ScientISST::Exception::Code). */
+typedef enum
+{
+    SCIENTISST_OK = 0,
+    SCIENTISST_INVALID_ADDRESS = 1,
+    SCIENTISST_BT_ADAPTER_NOT_FOUND,
+    SCIENTISST_DEVICE_NOT_FOUND,
+    SCIENTISST_CONTACTING_DEVICE,
+    SCIENTISST_PORT_COULD_NOT_BE_OPENED,
+    SCIENTISST_PORT_INITIALIZATION,
+    SCIENTISST_DEVICE_NOT_IDLE,
+    SCIENTISST_DEVICE_NOT_IN_ACQUISITION,
+    SCIENTISST_INVALID_PARAMETER,
+    SCIENTISST_NOT_SUPPORTED,
+    SCIENTISST_OUT_OF_MEMORY = 100,
+    SCIENTISST_UNKNOWN_ERROR
+} scientisst_status;
+
+typedef struct scientisst_device scientisst_device;    /* Opaque handle of a device */
+
+/* Frames of a block handed to a sink callback. The arrays are only valid during the callback.
+ * raw and mv hold the values of each channel after the other, capacity values apart. */
+typedef struct
+{
+    int num_frames;
+    int num_chs;
+    int capacity;
+    double sample_rate;
+    const int *chs;             /* Channel of each array (1...8 for AI1...AX2) */
+    const uint8_t *seq;         /* Sequence numbers (0...15) */
+    const uint8_t *digital;     /* Digital ports I1 I2 O1 O2 as bits 3...0 */
+    const int32_t *raw;         /* Raw values */
+    const int32_t *mv;          /* Values in mV for AI channels, sign extended for AX channels */
+} scientisst_block;
+
+typedef void (*scientisst_block_callback)(void *user, const scientisst_block *block);
+typedef void (*scientisst_gap_callback)(void *user, int gap_ms, int missing_frames);
+
+/* Description of a status code. */
+const char* scientisst_strerror(int status);
+
+/* Connects to a device, see ScientISST::ScientISST() for the addresses. *dev is NULL on failure. */
+int scientisst_open(const char *address, scientisst_device **dev);
+
+/* Stops an acquisition in progress and disconnects. dev may be NULL. */
+void scientisst_close(scientisst_device *dev);
+
+/* Copies the firmware version, truncated to len-1 characters and always terminated. */
+int scientisst_version(scientisst_device *dev, char *version, size_t len);
+
+/* Starts an acquisition of num_channels channels (1...8 for AI1...AX2), all channels if num_channels is 0.
+ * file is the CSV output file or NULL, api is 2 (binary) or 3 (JSON). */
+int scientisst_start(scientisst_device *dev, int sample_rate, const int *channels, int num_channels,
+                     const char *file, int simulated, int api);
+
+int scientisst_stop(scientisst_device *dev);
+
+/* Largest number of frames a scientisst_read() returns in this acquisition. */
+int scientisst_block_capacity(scientisst_device *dev, int *capacity);
+
+/* Reads the next block into the caller's buffers, each of max_frames frames per channel: seq and digital hold
+ * max_frames values, raw and mv hold the values of each channel after the other, max_frames values apart.
+ * Any buffer may be NULL. max_frames must be at least scientisst_block_capacity(). */
+int scientisst_read(scientisst_device *dev, uint8_t *seq, uint8_t *digital, int32_t *raw, int32_t *mv,
+                    int max_frames, int *num_frames);
+
+/* Sets the time span of the blocks of the next acquisitions, see ScientISST::blockDuration(). */
+int scientisst_block_duration(scientisst_device *dev, int ms);
+
+/* Calls on_block with every block of the next acquisitions, and on_gap (may be NULL) after each link loss,
+ * from the thread calling scientisst_read(). */
+int scientisst_add_sink(scientisst_device *dev, scientisst_block_callback on_block, scientisst_gap_callback on_gap, void *user);
+
+int scientisst_clear_sinks(scientisst_device *dev);
+
+/* Records the raw bytes of the next acquisitions to a capture file, NULL to stop capturing. */
+int scientisst_capture(scientisst_device *dev, const char *file);
+
+int scientisst_supervise(scientisst_device *dev, int enable);
+
+int scientisst_battery(scientisst_device *dev, int value);
+
+/* Sets the digital outputs O1 and O2 (0 or 1), num_outputs must be 2, or 0 to set all of them low. */
+int scientisst_trigger(scientisst_device *dev, const int *outputs, int num_outputs);
+
+int scientisst_dac(scientisst_device *dev, int value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
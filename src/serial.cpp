@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "serial.h"
+
+#ifdef __linux__
+
+#include <linux/serial.h>
+
+//struct termios2 of the asm-generic ABI, <asm/termbits.h> cannot be included together with <termios.h>
+#if defined(TCGETS2) && (defined(__x86_64__) || defined(__i386__) || defined(__arm__) || defined(__aarch64__) || defined(__riscv))
+#define HAS_TERMIOS2
+#define SERIAL_BOTHER   0010000
+
+struct termios2
+{
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+#endif
+
+#endif // __linux__
+
+#ifdef __APPLE__
+#include <IOKit/serial/ioss.h>
+#endif
+
+struct BaudConstant
+{
+    int baud;
+    speed_t constant;
+};
+
+static const BaudConstant baud_constants[] = {
+    {9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400},
+#ifdef B460800
+    {460800, B460800}, {500000, B500000}, {576000, B576000}, {921600, B921600}, {1000000, B1000000},
+    {1152000, B1152000}, {1500000, B1500000}, {2000000, B2000000}, {2500000, B2500000}, {3000000, B3000000},
+#endif
+};
+
+/*****************************************************************************/
+
+// Sets a rate without a Bxxx constant, once the rest of the port is configured.
+static bool setCustomBaud(int fd, int baud){
+#if defined(HAS_TERMIOS2)
+    struct termios2 t2;
+
+    if(ioctl(fd, TCGETS2, &t2) != 0)   return false;
+    t2.c_cflag &= ~CBAUD;
+    t2.c_cflag |= SERIAL_BOTHER;
+    t2.c_ispeed = baud;
+    t2.c_ospeed = baud;
+    return ioctl(fd, TCSETS2, &t2) == 0;
+
+#elif defined(__APPLE__)
+    speed_t speed = baud;
+    return ioctl(fd, IOSSIOSPEED, &speed) == 0;
+
+#else
+    return false;
+#endif
+}
+
+/*****************************************************************************/
+
+// Asks the driver to hand over received bytes at once instead of batching them (the FTDI latency timer drops to 1 ms).
+static void setLowLatency(int fd){
+#if defined(__linux__) && defined(ASYNC_LOW_LATENCY)
+    struct serial_struct serial;
+
+    if(ioctl(fd, TIOCGSERIAL, &serial) != 0)   return;     //Not a UART driver, nothing to tune
+    serial.flags |= ASYNC_LOW_LATENCY;
+    ioctl(fd, TIOCSSERIAL, &serial);
+#endif
+}
+
+/*****************************************************************************/
+
+int initSerial(const char *path, int baud){
+    speed_t constant = 0;
+
+    for(size_t i = 0; i < sizeof(baud_constants)/sizeof(baud_constants[0]); i++){
+        if(baud_constants[i].baud == baud)
+            constant = baud_constants[i].constant;
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NDELAY);
+    if (fd < 0)
+        return -1;
+
+    if (fcntl(fd, F_SETFL, 0) == -1)  // remove the O_NDELAY flag
+    {
+        close(fd);
+        return -2;
+    }
+
+    termios term;
+    if (tcgetattr(fd, &term) != 0)
+    {
+        close(fd);
+        return -2;
+    }
+
+    cfmakeraw(&term);
+    term.c_oflag &= ~(OPOST);
+
+    term.c_cc[VMIN] = 1;
+    term.c_cc[VTIME] = SERIAL_VTIME;
+
+    term.c_iflag &= ~(INPCK | PARMRK | ISTRIP | IGNCR | ICRNL | INLCR | IXON | IXOFF | IMAXBEL); // no flow control
+    term.c_iflag |= (IGNPAR | IGNBRK);
+
+    term.c_cflag &= ~(CRTSCTS | PARENB | CSTOPB | CSIZE); // no parity, 1 stop bit
+    term.c_cflag |= (CLOCAL | CREAD | CS8);    // raw mode, 8 bits
+
+    term.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHOPRT | ECHOK | ECHOKE | ECHONL | ECHOCTL | ISIG | IEXTEN | TOSTOP);  // raw mode
+
+    //A custom rate is set afterwards, the port runs at 115200 until then
+    if (cfsetspeed(&term, constant ? constant : B115200) != 0)
+    {
+        close(fd);
+        return -2;
+    }
+
+    if (tcsetattr(fd, TCSANOW, &term) != 0)
+    {
+        close(fd);
+        return -2;
+    }
+
+    if (constant == 0 && !setCustomBaud(fd, baud))
+    {
+        printf("Baud rate %d is not supported by this port\n", baud);
+        close(fd);
+        return -2;
+    }
+
+    setLowLatency(fd);
+
+    return fd;
+}
+
+/*****************************************************************************/
+
+bool setSerialReadSize(int fd, int min_bytes){
+    termios term;
+
+    if (tcgetattr(fd, &term) != 0)   return false;
+
+    //The speed bits read back are kept as they are, so a custom rate survives
+    term.c_cc[VMIN] = (min_bytes < 1) ? 1 : (min_bytes > SERIAL_MAX_VMIN) ? SERIAL_MAX_VMIN : min_bytes;
+    term.c_cc[VTIME] = SERIAL_VTIME;
+
+    return tcsetattr(fd, TCSANOW, &term) == 0;
+}
@@ -0,0 +1,17 @@
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#define SERIAL_DEFAULT_BAUD     115200          //Baud rate when the address does not give one
+#define SERIAL_MAX_VMIN         255             //Largest VMIN of termios
+#define SERIAL_VTIME            1               //Tenths of a second a read waits for the rest of VMIN once data flows
+
+/** Opens a serial port in raw mode, 8N1 without flow control. Rates without a Bxxx constant are set with
+    * termios2/BOTHER on Linux and IOSSIOSPEED on Mac OS. The driver is asked for low latency where it supports it.
+    * \return The descriptor, -1 if the port cannot be opened or -2 if it cannot be configured
+    */
+int initSerial(const char *path, int baud);
+
+/// Makes each read() of fd wait for min_bytes bytes, up to SERIAL_MAX_VMIN, once the first one arrived.
+bool setSerialReadSize(int fd, int min_bytes);
+
+#endif
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sink.h"
+#include "scientisst.h"
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+char* CsvSink::appendInt(char *p, int32_t value){
+    char digits[CSV_MAX_INT_CHARS];
+    char *d = digits+sizeof(digits);
+    uint32_t v = value < 0 ? 0u-(uint32_t)value : (uint32_t)value;
+
+    //Two digits at a time, from the least significant
+    while(v >= 100){
+        const char *pair = digit_pairs + 2*(v%100);
+        v /= 100;
+        *--d = pair[1];
+        *--d = pair[0];
+    }
+    if(v >= 10){
+        *--d = digit_pairs[2*v+1];
+        *--d = digit_pairs[2*v];
+    }else{
+        *--d = '0'+v;
+    }
+    if(value < 0)   *--d = '-';
+
+    const int len = digits+sizeof(digits)-d;
+    memcpy(p, d, len);
+    return p+len;
+}
+
+/*****************************************************************************/
+
+void CsvSink::open(const Block &layout){
+    char header[64];
+
+    close();
+
+    if(!file.open(file_name.c_str(), config)){
+        printf("Output file cannot be opened.");
+        exit(-1);
+    }
+
+    //Longest line: a two-digit sequence number, 4 digital ports and 2 values per channel, each followed by ", " or '\n'
+    buffer.resize(layout.capacity*(CSV_MAX_LINE_START + layout.num_chs*2*(CSV_MAX_INT_CHARS+2)));
+
+    std::string line = "NSeq, I1, I2, O1, O2, ";
+    for(int i = 0; i < layout.num_chs; i++){
+
+        if(layout.chs[i] == AX1 || layout.chs[i] == AX2){
+            if(i == layout.num_chs-1){
+                snprintf(header, sizeof(header), "AX%d", layout.chs[i]-6);
+            }else{
+                snprintf(header, sizeof(header), "AX%d, ", layout.chs[i]-6);
+            }
+        }else{
+            if(i == layout.num_chs-1){
+                snprintf(header, sizeof(header), "AI%d [raw], AI%d [mV]", layout.chs[i], layout.chs[i]);
+            }else{
+                snprintf(header, sizeof(header), "AI%d [raw], AI%d [mV], ", layout.chs[i], layout.chs[i]);
+            }
+        }
+        line += header;
+    }
+    line += "\n";
+    file.header(line.data(), line.size());
+}
+
+/*****************************************************************************/
+
+// Formats the whole block into the buffer and writes it at once.
+void CsvSink::write(const Block &b){
+    char *p = &buffer[0];
+
+    for(int n = 0; n < b.num_frames; n++){
+        const uint8_t dig = b.digital[n];
+
+        p = appendInt(p, b.seq[n]);
+        p[0] = ','; p[1] = ' '; p[2] = '0' + ((dig >> 3) & 1);
+        p[3] = ','; p[4] = ' '; p[5] = '0' + ((dig >> 2) & 1);
+        p[6] = ','; p[7] = ' '; p[8] = '0' + ((dig >> 1) & 1);
+        p[9] = ','; p[10] = ' '; p[11] = '0' + (dig & 1);
+        p += 12;
+
+        for(int i = 0; i < b.num_chs; i++){
+            *p++ = ','; *p++ = ' ';
+            p = appendInt(p, b.rawCh(i)[n]);
+            *p++ = ','; *p++ = ' ';
+            p = appendInt(p, b.mvCh(i)[n]);
+        }
+        if(b.num_chs == 0){
+            *p++ = ','; *p++ = ' ';
+        }
+        *p++ = '\n';
+    }
+
+    file.write(&buffer[0], p-&buffer[0]);
+}
+
+/*****************************************************************************/
+
+void CsvSink::gap(int gap_ms, int missing_frames){
+    char line[128];
+
+    const int len = snprintf(line, sizeof(line), "# Link lost, acquisition resumed after %d ms (about %d frames missing)\n", gap_ms, missing_frames);
+    file.write(line, len);
+}
+
+/*****************************************************************************/
+
+void CsvSink::close(void){
+    file.close();
+}
+
+/*****************************************************************************/
+
+void BinarySink::open(const Block &layout){
+    uint32_t header[3] = {BINARY_SINK_MAGIC, BINARY_SINK_VERSION, (uint32_t)layout.num_chs};
+    std::vector<uint8_t> bytes((uint8_t*)header, (uint8_t*)header + sizeof(header));
+
+    close();
+
+    if(!file.open(file_name.c_str(), config)){
+        printf("Output file cannot be opened.");
+        exit(-1);
+    }
+
+    bytes.insert(bytes.end(), (const uint8_t*)&layout.sample_rate, (const uint8_t*)(&layout.sample_rate+1));
+    bytes.insert(bytes.end(), (const uint8_t*)layout.chs, (const uint8_t*)(layout.chs+layout.num_chs));
+    file.header(&bytes[0], bytes.size());
+}
+
+/*****************************************************************************/
+
+void BinarySink::write(const Block &b){
+    uint32_t num_frames = b.num_frames;
+
+    file.write(&num_frames, sizeof(num_frames));
+    file.write(&b.seq[0], num_frames);
+    file.write(&b.digital[0], num_frames);
+    for(int i = 0; i < b.num_chs; i++)
+        file.write(b.rawCh(i), num_frames*sizeof(int32_t));
+    for(int i = 0; i < b.num_chs; i++)
+        file.write(b.mvCh(i), num_frames*sizeof(int32_t));
+}
+
+/*****************************************************************************/
+
+void BinarySink::gap(int gap_ms, int missing_frames){
+    uint32_t record[3] = {BINARY_SINK_GAP, (uint32_t)gap_ms, (uint32_t)missing_frames};
+
+    file.write(record, sizeof(record));
+}
+
+/*****************************************************************************/
+
+void BinarySink::close(void){
+    file.close();
+}
+
+/*****************************************************************************/
+
+void MemorySink::write(const Block &b){
+    if(max_blocks && blocks.size() == max_blocks)
+        blocks.pop_front();
+
+    blocks.push_back(b);
+}
@@ -0,0 +1,110 @@
+#ifndef _SINK_H
+#define _SINK_H
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+#include "block.h"
+#include "writer.h"
+
+#define BINARY_SINK_MAGIC   0x42535343      //"CSSB" read as a little endian integer
+#define BINARY_SINK_VERSION 1
+#define BINARY_SINK_GAP     0xFFFFFFFF      //num_frames of a record marking a link loss
+
+#define CSV_MAX_INT_CHARS   11              //"-2147483648"
+#define CSV_MAX_LINE_START  17              //"15, 1, 1, 1, 1, " and '\n'
+
+// Destination of the acquired blocks. A device hands every block of an acquisition, after filtering,
+// to each of its sinks in the order they were added (see ScientISST::addSink()).
+class Sink
+{
+public:
+    virtual ~Sink() {}
+
+    /** Called by ScientISST::start() before the first block. layout holds the channels and the sample rate of the blocks to come.
+        * A sink that cannot use them throws ScientISST::Exception, and start() stops the acquisition.
+        */
+    virtual void open(const Block &layout) {}
+
+    /// Called with every block. The arrays are only valid until the call returns.
+    virtual void write(const Block &b) = 0;
+
+    /// Called after the block preceding a link loss of gap_ms, in which about missing_frames frames, at the
+    /// sample rate of the blocks, were lost.
+    virtual void gap(int gap_ms, int missing_frames) {}
+
+    /// Called by ScientISST::stop().
+    virtual void close(void) {}
+};
+
+// Writes the blocks in the CSV format of ScientISST::start(): a header line, one line per frame and a line
+// starting with '#' at each link loss. Each block is formatted into a buffer and handed to the FileWriter at once.
+class CsvSink : public Sink
+{
+public:
+    /// \param[in] _config Checkpoints and rotation of the file, see FileWriter. Each segment starts with the header line.
+    CsvSink(const char *_file_name, const WriterConfig &_config = WriterConfig()) : file_name(_file_name), config(_config) {}
+    virtual ~CsvSink() { close(); }
+
+    virtual void open(const Block &layout);
+    virtual void write(const Block &b);
+    virtual void gap(int gap_ms, int missing_frames);
+    virtual void close(void);
+
+    /// Writes the decimal digits of value at p, as printf("%d") does, and returns the end of the digits.
+    static char* appendInt(char *p, int32_t value);
+
+private:
+    std::string file_name;
+    WriterConfig config;
+    FileWriter file;
+    std::vector<char> buffer;
+};
+
+// Writes the blocks in a compact binary format, in host byte order:
+//   header: uint32 BINARY_SINK_MAGIC, uint32 BINARY_SINK_VERSION, uint32 num_chs, double sample_rate, int32 chs[num_chs]
+//   block:  uint32 num_frames, uint8 seq[num_frames], uint8 digital[num_frames],
+//           int32 raw[num_chs][num_frames], int32 mv[num_chs][num_frames]
+//   gap:    uint32 BINARY_SINK_GAP, int32 gap_ms, int32 missing_frames
+class BinarySink : public Sink
+{
+public:
+    BinarySink(const char *_file_name, const WriterConfig &_config = WriterConfig()) : file_name(_file_name), config(_config) {}
+    virtual ~BinarySink() { close(); }
+
+    virtual void open(const Block &layout);
+    virtual void write(const Block &b);
+    virtual void gap(int gap_ms, int missing_frames);
+    virtual void close(void);
+
+private:
+    std::string file_name;
+    WriterConfig config;
+    FileWriter file;
+};
+
+// Discards the blocks, for consumers that only use ScientISST::block after each read().
+class NullSink : public Sink
+{
+public:
+    virtual void write(const Block &b) {}
+};
+
+// Keeps a copy of the last blocks in memory. Not thread safe, read it from the thread calling ScientISST::read().
+class MemorySink : public Sink
+{
+public:
+    /// \param[in] _max_blocks Number of blocks kept, the oldest are dropped. 0 keeps all of them.
+    MemorySink(size_t _max_blocks = 0) : max_blocks(_max_blocks) {}
+
+    virtual void open(const Block &layout) { blocks.clear(); }
+    virtual void write(const Block &b);
+
+    std::deque<Block> blocks;   ///< Blocks received since the last start(), oldest first
+
+private:
+    size_t max_blocks;
+};
+
+#endif
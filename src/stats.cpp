@@ -0,0 +1,95 @@
+#include <cmath>
+#include <cstdlib>
+#include "stats.h"
+
+#define AX_MIN  (-(1 << 23))
+#define AX_MAX  ((1 << 23)-1)
+#define AI_MAX  4095
+
+/*****************************************************************************/
+
+void Stats::reset(const Block &block, int sample_rate){
+    std::lock_guard<std::mutex> guard(lock);
+
+    accs.assign(block.num_chs, Accumulator());
+    for(int c = 0; c < block.num_chs; c++){
+        Accumulator &a = accs[c];
+        a.out.channel = block.chs[c];
+        a.out.count = 0;
+        a.out.mean = 0;
+        a.out.variance = 0;
+        a.out.min = INT32_MAX;
+        a.out.max = INT32_MIN;
+        a.out.saturated = 0;
+        a.out.rms = 0;
+        a.out.flatline = false;
+        a.m2 = 0;
+        a.ew_mean = 0;
+        a.ew_power = 0;
+        a.last_raw = 0;
+        a.flat_run = 0;
+    }
+
+    alpha = 1.0 - exp(-1000.0/((double)sample_rate*STATS_WINDOW_MS));
+    flat_samples = (uint64_t)sample_rate*STATS_FLAT_MS/1000;
+}
+
+/*****************************************************************************/
+
+void Stats::update(const Block &block){
+    std::lock_guard<std::mutex> guard(lock);
+
+    for(int c = 0; c < block.num_chs && c < (int)accs.size(); c++){
+        Accumulator &a = accs[c];
+        const int32_t *raw = block.rawCh(c);
+        const int32_t *mv = block.mvCh(c);
+        const bool is_ax = (a.out.channel >= 7);
+
+        for(int n = 0; n < block.num_frames; n++){
+            const double x = mv[n];
+
+            if(a.out.count++ == 0){
+                a.ew_mean = x;
+                a.last_raw = raw[n];
+            }
+
+            const double delta = x - a.out.mean;
+            a.out.mean += delta/a.out.count;
+            a.m2 += delta*(x - a.out.mean);
+
+            if(mv[n] < a.out.min)   a.out.min = mv[n];
+            if(mv[n] > a.out.max)   a.out.max = mv[n];
+
+            if(is_ax ? (mv[n] == AX_MIN || mv[n] == AX_MAX) : (raw[n] == 0 || raw[n] == AI_MAX))
+                a.out.saturated++;
+
+            const double dev = x - a.ew_mean;
+            a.ew_mean += alpha*dev;
+            a.ew_power += alpha*(dev*dev - a.ew_power);
+
+            if(abs(raw[n] - a.last_raw) <= STATS_FLAT_TOLERANCE){
+                a.flat_run++;
+            }else{
+                a.flat_run = 0;
+                a.last_raw = raw[n];
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+
+VChannelStats Stats::snapshot(void){
+    std::lock_guard<std::mutex> guard(lock);
+    VChannelStats res(accs.size());
+
+    for(size_t c = 0; c < accs.size(); c++){
+        const Accumulator &a = accs[c];
+        res[c] = a.out;
+        res[c].variance = (a.out.count > 1) ? a.m2/(a.out.count-1) : 0;
+        res[c].rms = sqrt(a.ew_power);
+        res[c].flatline = (a.out.count > 0 && a.flat_run >= flat_samples);
+    }
+
+    return res;
+}
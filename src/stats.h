@@ -0,0 +1,59 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "block.h"
+
+#define STATS_WINDOW_MS         1000    //Time constant of the exponential window of the RMS
+#define STATS_FLAT_MS           2000    //Time without change after which a channel is reported as flatline
+#define STATS_FLAT_TOLERANCE    1       //Max change in raw value still considered flat
+
+/// Signal quality statistics of one channel, see ScientISST::stats().
+struct ChannelStats
+{
+    int channel;            ///< Channel (AI1...AX2)
+    uint64_t count;         ///< Number of samples since start()
+    double mean;            ///< Mean since start(), in mV (sign extended value for AX channels)
+    double variance;        ///< Variance since start()
+    int32_t min;            ///< Minimum value since start()
+    int32_t max;            ///< Maximum value since start()
+    uint64_t saturated;     ///< Number of samples at the ADC limits (raw 0 or 4095 for AI, -2^23 or 2^23-1 for AX)
+    double rms;             ///< RMS around the mean over the last STATS_WINDOW_MS (exponential window)
+    bool flatline;          ///< The raw value hasn't changed for STATS_FLAT_MS, e.g. a detached electrode
+};
+typedef std::vector<ChannelStats> VChannelStats;
+
+// Incremental per channel statistics, updated in O(1) per sample without keeping any history.
+// update() is called by the acquisition thread, snapshot() can be called from any other thread.
+class Stats
+{
+public:
+    /// Clears the statistics for the channels of block, acquired at sample_rate.
+    void reset(const Block &block, int sample_rate);
+
+    /// Adds the frames of a block, which must have the channels given to reset().
+    void update(const Block &block);
+
+    /// Returns a copy of the current statistics of every channel.
+    VChannelStats snapshot(void);
+
+private:
+    struct Accumulator
+    {
+        ChannelStats out;
+        double m2;          //Sum of squared differences from the mean (Welford)
+        double ew_mean;     //Exponentially weighted mean and power around it, for the RMS
+        double ew_power;
+        int32_t last_raw;
+        uint32_t flat_run;  //Consecutive samples within STATS_FLAT_TOLERANCE of last_raw
+    };
+
+    std::vector<Accumulator> accs;
+    double alpha;           //Exponential window weight of a new sample
+    uint32_t flat_samples;
+    std::mutex lock;
+};
+
+#endif
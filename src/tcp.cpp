@@ -7,8 +7,42 @@
 #include <netinet/in.h> 
 #include <unistd.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
 #include "tcp.h"
 
+//Low latency, dead link detection and SIGPIPE options shared by both ends of a connection
+static void setSocketOptions(int fd){
+    int opt;
+
+    opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));    //Commands are tiny, don't let Nagle hold them back
+
+    opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+#ifdef SO_NOSIGPIPE     //Mac OS has no MSG_NOSIGNAL, a send to a closed connection must not raise SIGPIPE
+    opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif
+#ifdef TCP_KEEPIDLE
+    opt = TCP_KEEPALIVE_IDLE;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &opt, sizeof(opt));
+#elif defined(TCP_KEEPALIVE)    //Mac OS
+    opt = TCP_KEEPALIVE_IDLE;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPALIVE, &opt, sizeof(opt));
+#endif
+#ifdef TCP_KEEPINTVL
+    opt = TCP_KEEPALIVE_INTVL;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &opt, sizeof(opt));
+#endif
+#ifdef TCP_KEEPCNT
+    opt = TCP_KEEPALIVE_CNT;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &opt, sizeof(opt));
+#endif
+}
+
 int initTcpServer(char* port_str){
     int port;
     int listen_fd;
@@ -45,5 +79,79 @@ int initTcpServer(char* port_str){
         exit(-1);
 	}
 
+    setSocketOptions(client_fd);
+
 	return client_fd;
+}
+
+int initTcpClient(const char* host, const char* port_str){
+    struct addrinfo hints;
+    struct addrinfo *res;
+    int fd;
+    int flags;
+    int opt;
+    int err;
+    socklen_t err_len = sizeof(err);
+    fd_set writefds;
+    struct timeval timeout;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if((err = getaddrinfo(host, port_str, &hints, &res)) != 0){
+        printf("getaddrinfo: %s\n", gai_strerror(err));
+        return -1;
+    }
+
+    if((fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0){
+        perror("socket: ");
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    //Must be set before connect so the window scale is negotiated accordingly
+    opt = TCP_RCVBUF_SIZE;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+
+    //Connect in non-blocking mode so an unreachable device doesn't block for the kernel's SYN timeout
+    flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    if(connect(fd, res->ai_addr, res->ai_addrlen) < 0){
+        if(errno != EINPROGRESS){
+            perror("connect: ");
+            freeaddrinfo(res);
+            close(fd);
+            return -1;
+        }
+
+        FD_ZERO(&writefds);
+        FD_SET(fd, &writefds);
+        timeout.tv_sec = TCP_CONNECT_TIMEOUT_MS/1000;
+        timeout.tv_usec = (TCP_CONNECT_TIMEOUT_MS%1000)*1000;
+
+        if(select(fd+1, NULL, &writefds, NULL, &timeout) <= 0){
+            printf("connect: Timed out connecting to %s:%s\n", host, port_str);
+            freeaddrinfo(res);
+            close(fd);
+            return -1;
+        }
+
+        if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err != 0){
+            printf("connect: %s\n", strerror(err));
+            freeaddrinfo(res);
+            close(fd);
+            return -1;
+        }
+    }
+    freeaddrinfo(res);
+
+    fcntl(fd, F_SETFL, flags);  //Back to blocking mode, recv() relies on select() for timeouts
+
+    setSocketOptions(fd);
+
+    printf("Connected to %s:%s\n", host, port_str);
+
+    return fd;
 }
\ No newline at end of file
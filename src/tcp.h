@@ -1,7 +1,13 @@
 #ifndef _TCP_H
 #define _TCP_H
 
+#define TCP_CONNECT_TIMEOUT_MS      5000            //Max time waiting for a non-blocking connect to complete
+#define TCP_RCVBUF_SIZE             (128*1024)      //Kernel receive buffer, enough for ~1s of the fastest live mode
+#define TCP_KEEPALIVE_IDLE          5               //Seconds of silence before the first keepalive probe
+#define TCP_KEEPALIVE_INTVL         1               //Seconds between keepalive probes
+#define TCP_KEEPALIVE_CNT           3               //Unanswered probes before the connection is dropped
+
 int initTcpServer(char* port_str);
-//int initTcpClient(char* ip, char* port);
+int initTcpClient(const char* host, const char* port_str);
 
-#endif
\ No newline at end of file
+#endif
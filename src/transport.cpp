@@ -0,0 +1,522 @@
+#ifdef _WIN32 // 32-bit or 64-bit Windows
+
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include <winsock2.h>
+#include <ws2bth.h>
+
+#else // Linux or Mac OS
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#ifdef HASBLUETOOTH  // Linux only
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/rfcomm.h>
+
+#endif // HASBLUETOOTH
+
+#endif // Linux or Mac OS
+
+#include <algorithm>
+#include <cstdio>
+#include "transport.h"
+#include "scientisst.h"
+#include "replay.h"
+#include "serial.h"
+
+#ifndef MSG_NOSIGNAL    //Mac OS, the sockets are set to SO_NOSIGPIPE instead
+#define MSG_NOSIGNAL 0
+#endif
+#include "tcp.h"
+#include "udp.h"
+#include "inventory.h"
+
+typedef ScientISST::Exception Exception;
+
+// Splits "<port>:<baud rate>" in place, returns SERIAL_DEFAULT_BAUD if no rate is given.
+// Only digits may follow the last ':', as device paths like /dev/serial/by-path/... hold colons too.
+static int parseBaud(std::string &port){
+    const size_t colon = port.rfind(':');
+
+    if(colon == std::string::npos || colon+1 == port.size() || port.find_first_not_of("0123456789", colon+1) != std::string::npos)
+        return SERIAL_DEFAULT_BAUD;
+
+    const int baud = atoi(port.c_str()+colon+1);
+    port.erase(colon);
+    return baud;
+}
+
+/*****************************************************************************/
+
+Transport* Transport::open(const char *address){
+#ifdef _WIN32
+    if (_memicmp(address, "COM", 3) == 0){
+        std::string port(address);
+        const int baud = parseBaud(port);
+        return new SerialTransport(port.c_str(), baud);
+    }
+
+    return new RfcommTransport(address);    // address is a Bluetooth MAC address
+
+#else // Linux or Mac OS
+
+    if (memcmp(address, "/dev/", 5) == 0){
+        std::string path(address);
+        const int baud = parseBaud(path);
+        return new SerialTransport(path.c_str(), baud);    //Any board can be plugged into the port, no key
+
+    //Setup as an Wifi server
+    }else if(memcmp(address, "server", 6) == 0){
+        char *port_str;
+
+        port_str = (char*)strrchr(address, ':')+1;  //+1 to remove the ':'
+        if(port_str == NULL){
+            printf("Error in reading server port number, example usage: ./scientisst server_tcp:25565\n");
+            exit(-1);
+        }
+
+        //Tcp server
+        if(memcmp(strrchr(address, '_')+1, "tcp", 3) == 0){
+            return new TcpServerTransport(port_str);
+        //Udp server
+        }else if(memcmp(strrchr(address, '_')+1, "udp", 3) == 0){
+            return new UdpTransport(port_str);
+        }
+        throw Exception(Exception::INVALID_ADDRESS);
+
+    //Setup as a Wifi client of a device acting as TCP server
+    }else if(memcmp(address, "client", 6) == 0){
+        const char *host_str = strchr(address, ':');
+        const char *port_str = strrchr(address, ':');
+        const char *proto_str = strchr(address, '_');
+
+        if(host_str == NULL || port_str == host_str || proto_str == NULL || memcmp(proto_str+1, "tcp", 3) != 0){
+            printf("Error in reading device address, example usage: ./scientisst client_tcp:192.168.4.1:8800\n");
+            throw Exception(Exception::INVALID_ADDRESS);
+        }
+
+        //Any board can answer at the address, no key
+        return new TcpClientTransport(std::string(host_str+1, port_str-host_str-1).c_str(), port_str+1);
+
+    //Play back a capture as a device, at the speed it was recorded or scaled by "@<factor>", "@max" for no pacing
+    }else if(memcmp(address, "replay:", 7) == 0){
+        const char *speed_str = strrchr(address, '@');
+        std::string replay_file(address+7, speed_str ? speed_str-address-7 : strlen(address+7));
+        double speed = 1;
+
+        if(speed_str != NULL && strcmp(speed_str+1, "max") == 0){
+            speed = 0;
+        }else if(speed_str != NULL){
+            char *end;
+            speed = strtod(speed_str+1, &end);
+            if(*end != '\0' || speed <= 0)   replay_file.clear();
+        }
+        if(replay_file.empty()){
+            printf("Error in reading replay address, example usage: ./scientisst replay:capture.raw@10\n");
+            throw Exception(Exception::INVALID_ADDRESS);
+        }
+
+        return new ReplayTransport(replay_file.c_str(), speed);
+    }
+
+#ifdef HASBLUETOOTH
+    return new RfcommTransport(address);    // address is a Bluetooth MAC address
+#else
+    throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+#endif // HASBLUETOOTH
+
+#endif // Linux or Mac OS
+}
+
+/*****************************************************************************/
+
+void Transport::flush(int timeout_ms){
+    uint8_t buff[256];
+
+    while(recv(buff, sizeof(buff), timeout_ms) > 0);
+}
+
+/*****************************************************************************/
+
+#ifdef _WIN32 // 32-bit or 64-bit Windows
+
+SerialTransport::SerialTransport(const char *port, int baud) : Transport(COM_MODE_UART){
+   char xport[40] = "\\\\.\\";   // preppend "\\.\"
+
+   strcat_s(xport, 40, port);
+
+   hCom = CreateFileA(xport,  // comm port name
+                   GENERIC_READ | GENERIC_WRITE,
+                   0,      // comm devices must be opened w/exclusive-access
+                   NULL,   // no security attributes
+                   OPEN_EXISTING, // comm devices must use OPEN_EXISTING
+                   0,      // not overlapped I/O
+                   NULL);  // hTemplate must be NULL for comm devices
+
+   if (hCom == INVALID_HANDLE_VALUE)
+      throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+
+   DCB dcb;
+   if (!GetCommState(hCom, &dcb))
+   {
+      CloseHandle(hCom);
+      throw Exception(Exception::PORT_INITIALIZATION);
+   }
+   dcb.BaudRate = baud;    // any rate the driver supports, not only the CBR_ constants
+   dcb.fBinary = TRUE;
+   dcb.fParity = FALSE;
+   dcb.fOutxCtsFlow = FALSE;
+   dcb.fOutxDsrFlow = FALSE;
+   dcb.fDtrControl = DTR_CONTROL_DISABLE;
+   dcb.fDsrSensitivity = FALSE;
+   dcb.fOutX = FALSE;
+   dcb.fInX = FALSE;
+   dcb.fNull = FALSE;
+   dcb.fRtsControl = RTS_CONTROL_ENABLE;
+   dcb.ByteSize = 8;
+   dcb.Parity = NOPARITY;
+   dcb.StopBits = ONESTOPBIT;
+   if (!SetCommState(hCom, &dcb))
+   {
+      CloseHandle(hCom);
+      throw Exception(Exception::PORT_INITIALIZATION);
+   }
+
+   COMMTIMEOUTS ct;
+   ct.ReadIntervalTimeout         = 0;
+   ct.ReadTotalTimeoutConstant    = 5000; // 5 s
+   ct.ReadTotalTimeoutMultiplier  = 0;
+   ct.WriteTotalTimeoutConstant   = 5000; // 5 s
+   ct.WriteTotalTimeoutMultiplier = 0;
+
+   if (!SetCommTimeouts(hCom, &ct))
+   {
+      CloseHandle(hCom);
+      throw Exception(Exception::PORT_INITIALIZATION);
+   }
+}
+
+/*****************************************************************************/
+
+SerialTransport::~SerialTransport(){
+    CloseHandle(hCom);
+}
+
+/*****************************************************************************/
+
+bool SerialTransport::send(const uint8_t *data, int len){
+    DWORD nbytwritten = 0;
+
+    return WriteFile(hCom, data, len, &nbytwritten, NULL) && nbytwritten == (DWORD)len;
+}
+
+/*****************************************************************************/
+
+// Reads with the timeouts set on the port, the read returns when len bytes arrived or after 5 s.
+int SerialTransport::recv(void *data, int len, int timeout_ms){
+    DWORD nbytread = 0;
+
+    if (!ReadFile(hCom, data, len, &nbytread, NULL))
+        return -1;
+
+    if (nbytread == 0)
+    {
+        DWORD stat;
+        if (!GetCommModemStatus(hCom, &stat) || !(stat & MS_DSR_ON))
+            return -1;  // connection is lost
+
+        return 0;   // a timeout occurred
+    }
+
+    return nbytread;
+}
+
+/*****************************************************************************/
+
+void SerialTransport::flush(int timeout_ms){
+    PurgeComm(hCom, PURGE_RXCLEAR);
+}
+
+/*****************************************************************************/
+
+RfcommTransport::RfcommTransport(const char *address) : Transport(COM_MODE_BT){
+   WSADATA m_data;
+   if (WSAStartup(0x202, &m_data) != 0)
+      throw Exception(Exception::PORT_INITIALIZATION);
+
+   SOCKADDR_BTH so_bt;
+   int siz = sizeof so_bt;
+   if (WSAStringToAddressA((LPSTR)address, AF_BTH, NULL, (sockaddr*)&so_bt, &siz) != 0)
+   {
+      WSACleanup();
+      throw Exception(Exception::INVALID_ADDRESS);
+   }
+   so_bt.port = 1;
+
+   fd = socket(AF_BTH, SOCK_STREAM, BTHPROTO_RFCOMM);
+   if (fd == INVALID_SOCKET)
+   {
+      WSACleanup();
+      throw Exception(Exception::PORT_INITIALIZATION);
+   }
+
+   DWORD rcvbufsiz = 128*1024; // 128k
+   setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*) &rcvbufsiz, sizeof rcvbufsiz);
+
+   if (connect(fd, (const sockaddr*)&so_bt, sizeof so_bt) != 0)
+   {
+      int err = WSAGetLastError();
+      closesocket(fd);
+      WSACleanup();
+
+      switch(err)
+      {
+      case WSAENETDOWN:
+         throw Exception(Exception::BT_ADAPTER_NOT_FOUND);
+
+      case WSAETIMEDOUT:
+         throw Exception(Exception::DEVICE_NOT_FOUND);
+
+      default:
+         throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+      }
+   }
+}
+
+/*****************************************************************************/
+
+RfcommTransport::~RfcommTransport(){
+    closesocket(fd);
+    WSACleanup();
+}
+
+/*****************************************************************************/
+
+bool RfcommTransport::send(const uint8_t *data, int len){
+    return ::send(fd, (const char*)data, len, 0) == len;
+}
+
+/*****************************************************************************/
+
+int RfcommTransport::recv(void *data, int len, int timeout_ms){
+    fd_set readfds;
+    timeval timeout;
+
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    timeout.tv_sec = timeout_ms/1000;
+    timeout.tv_usec = (timeout_ms%1000)*1000;
+
+    int state = select(FD_SETSIZE, &readfds, NULL, NULL, &timeout);
+    if(state == 0)   return 0;
+    if(state < 0)    return -1;
+
+    int ret = ::recv(fd, (char*)data, len, 0);
+    return (ret > 0) ? ret : -1;
+}
+
+#else // Linux or Mac OS
+
+FdTransport::~FdTransport(){
+    if(fd >= 0)   ::close(fd);
+}
+
+/*****************************************************************************/
+
+// A link closed by the device fails the send instead of raising SIGPIPE, which would kill the process.
+bool FdTransport::send(const uint8_t *data, int len){
+    return fd >= 0 && ::send(fd, data, len, MSG_NOSIGNAL) == len;
+}
+
+/*****************************************************************************/
+
+int FdTransport::recv(void *data, int len, int timeout_ms){
+    fd_set readfds;
+    timeval timeout;
+
+    if(fd < 0)   return -1;
+
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    timeout.tv_sec = timeout_ms/1000;
+    timeout.tv_usec = (timeout_ms%1000)*1000;
+
+    int state = select(fd+1, &readfds, NULL, NULL, &timeout);
+    if(state == 0)   return 0;
+    if(state < 0)    return -1;
+
+    ssize_t ret = ::read(fd, data, len);
+    return (ret > 0) ? ret : -1;
+}
+
+/*****************************************************************************/
+
+SerialTransport::SerialTransport(const char *path, int baud) : FdTransport(COM_MODE_UART){
+    fd = initSerial(path, baud);
+    if (fd == -1)
+        throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+    if (fd < 0)
+        throw Exception(Exception::PORT_INITIALIZATION);
+}
+
+/*****************************************************************************/
+
+bool SerialTransport::send(const uint8_t *data, int len){
+    return fd >= 0 && write(fd, data, len) == len;
+}
+
+/*****************************************************************************/
+
+void SerialTransport::setReadSize(int packet_size, int block_size){
+    int vmin = std::min(block_size, SERIAL_MAX_VMIN);
+
+    vmin -= vmin % packet_size;
+    setSerialReadSize(fd, std::max(vmin, 1));
+}
+
+/*****************************************************************************/
+
+TcpServerTransport::TcpServerTransport(char *port_str) : FdTransport(COM_MODE_TCP_SV, initTcpServer(port_str)){
+    fixed_commands = true;
+}
+
+/*****************************************************************************/
+
+UdpTransport::UdpTransport(char *port_str) : FdTransport(COM_MODE_UDP){
+    fd = initUdpServer(port_str, &client_addr, &client_addr_len);
+    fixed_commands = true;
+}
+
+/*****************************************************************************/
+
+bool UdpTransport::send(const uint8_t *data, int len){
+    if (sendto(fd, data, len, 0, (const struct sockaddr *) (&client_addr), client_addr_len) == -1) {
+        perror("ERROR: sendto");
+    }
+    return true;
+}
+
+/*****************************************************************************/
+
+TcpClientTransport::TcpClientTransport(const char *_host, const char *_port) : FdTransport(COM_MODE_TCP_CL), host(_host), port(_port){
+    fixed_commands = true;
+
+    fd = initTcpClient(host.c_str(), port.c_str());
+    if(fd < 0)
+        throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+}
+
+/*****************************************************************************/
+
+bool TcpClientTransport::reconnect(void){
+    if(fd >= 0)   ::close(fd);
+
+    fd = initTcpClient(host.c_str(), port.c_str());
+    return fd >= 0;
+}
+
+/*****************************************************************************/
+
+#ifdef HASBLUETOOTH
+
+RfcommTransport::RfcommTransport(const char *address) : FdTransport(COM_MODE_BT){
+    bdaddr_t bdaddr;
+    Inventory::Entry entry;
+
+    if (str2ba(address, &bdaddr) == 0)
+        bt_address = address;
+    else if (Inventory::instance().lookup(address, entry) && str2ba(entry.macAddr.c_str(), &bdaddr) == 0)
+        bt_address = entry.macAddr;     // name of a device known to the inventory, no discovery needed
+    else
+        throw Exception(Exception::INVALID_ADDRESS);
+
+    key = bt_address;
+
+    int ret = connect();
+    if (ret == -1)
+        throw Exception(Exception::PORT_INITIALIZATION);
+    if (ret < 0)
+        throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+}
+
+/*****************************************************************************/
+
+bool RfcommTransport::reconnect(void){
+    if(fd >= 0)   ::close(fd);
+    fd = -1;
+
+    return connect() >= 0;
+}
+
+/*****************************************************************************/
+
+// Opens the RFCOMM socket. Returns 0, -1 if a socket could not be created or -2 if the device could not be reached.
+int RfcommTransport::connect(void){
+    sockaddr_rc so_bt;
+    so_bt.rc_family = AF_BLUETOOTH;
+    str2ba(bt_address.c_str(), &so_bt.rc_bdaddr);
+    so_bt.rc_channel = 1;
+
+    int link_fd = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+    if (link_fd < 0)
+        return -1;
+
+    if (::connect(link_fd, (const sockaddr*)&so_bt, sizeof so_bt) != 0)
+    {
+        ::close(link_fd);
+        return -2;
+    }
+
+    fd = link_fd;
+    return 0;
+}
+
+#endif // HASBLUETOOTH
+
+/*****************************************************************************/
+
+LoopbackTransport::LoopbackTransport(int _mode) : FdTransport(_mode){
+    int sv[2];
+
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+        perror("socketpair");
+        throw Exception(Exception::PORT_INITIALIZATION);
+    }
+    fd = sv[0];
+    peer_fd = sv[1];
+#ifdef SO_NOSIGPIPE     //Mac OS
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif
+    fixed_commands = true;
+}
+
+/*****************************************************************************/
+
+LoopbackTransport::~LoopbackTransport(){
+    ::close(peer_fd);
+}
+
+/*****************************************************************************/
+
+ReplayTransport::ReplayTransport(const char *file_name, double speed) : LoopbackTransport(COM_MODE_REPLAY){
+    replay = new Replay();
+
+    if(!replay->open(file_name, speed, peer())){
+        delete replay;
+        throw Exception(Exception::PORT_COULD_NOT_BE_OPENED);
+    }
+}
+
+/*****************************************************************************/
+
+ReplayTransport::~ReplayTransport(){
+    delete replay;
+}
+
+#endif // Linux or Mac OS
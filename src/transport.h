@@ -0,0 +1,212 @@
+#ifndef _TRANSPORT_H
+#define _TRANSPORT_H
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32 // 32-bit or 64-bit Windows
+
+#include <winsock2.h>
+
+#else // Linux or Mac OS
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#endif
+
+#define COM_MODE_BT         0
+#define COM_MODE_UART       1
+#define COM_MODE_TCP_SV     2
+#define COM_MODE_TCP_CL     3
+#define COM_MODE_UDP        4
+#define COM_MODE_REPLAY     5
+#define COM_MODE_LOOPBACK   6
+
+class Replay;
+
+// A link to a device. ScientISST only sends commands and reads the bytes that arrive through it, each
+// transport does so in the way that suits its link, and reopens it if the host is the one dialing out.
+class Transport
+{
+public:
+    Transport(int _mode) : mode(_mode), fixed_commands(false) {}
+    virtual ~Transport() {}
+
+    /** Opens the link of a device address, see ScientISST::ScientISST().
+        * \exception ScientISST::Exception (PORT_COULD_NOT_BE_OPENED, PORT_INITIALIZATION, INVALID_ADDRESS, ...)
+        */
+    static Transport* open(const char *address);
+
+    /// Sends a command, returns false if the link is lost.
+    virtual bool send(const uint8_t *data, int len) = 0;
+
+    /** Reads the bytes that arrived, up to len, waiting up to timeout_ms for the first one.
+        * \return Number of bytes read, 0 on timeout or -1 if the link is closed or lost
+        */
+    virtual int recv(void *data, int len, int timeout_ms) = 0;
+
+    /// Discards everything still arriving, returning once the link has been silent for timeout_ms.
+    virtual void flush(int timeout_ms);
+
+    /** Tells the link how the reader consumes the data, so it can return whole packets in fewer reads.
+        * \param[in] packet_size Bytes of a packet, 1 when idle
+        * \param[in] block_size Bytes the reader waits for anyway before it goes on
+        */
+    virtual void setReadSize(int packet_size, int block_size) {}
+
+    /// Descriptor that becomes readable when bytes arrive, for poll(), or -1 if the link has none.
+    virtual int handle(void) const { return -1; }
+
+    /// Makes one attempt to open the link again after it was lost, returns false if it failed.
+    virtual bool reconnect(void) { return false; }
+
+    /// True if reconnect() can work, only for links the host dials out to.
+    virtual bool canReconnect(void) const { return false; }
+
+    const int mode;             ///< COM_MODE_* of the link
+    bool fixed_commands;        ///< Commands are padded to CMD_MAX_BYTES, as sockets need
+    std::string key;            ///< Identity of the device itself (its Bluetooth MAC address), its inventory key, empty if the link doesn't tell
+};
+
+#ifdef _WIN32 // 32-bit or 64-bit Windows
+
+// Bluetooth virtual COM port or USB-UART COM port ("COMx" or "COMx:<baud rate>").
+class SerialTransport : public Transport
+{
+public:
+    SerialTransport(const char *port, int baud);
+    virtual ~SerialTransport();
+
+    virtual bool send(const uint8_t *data, int len);
+    virtual int recv(void *data, int len, int timeout_ms);
+    virtual void flush(int timeout_ms);
+
+private:
+    HANDLE hCom;
+};
+
+// Bluetooth RFCOMM socket to a device MAC address.
+class RfcommTransport : public Transport
+{
+public:
+    RfcommTransport(const char *address);
+    virtual ~RfcommTransport();
+
+    virtual bool send(const uint8_t *data, int len);
+    virtual int recv(void *data, int len, int timeout_ms);
+
+private:
+    SOCKET fd;
+};
+
+#else // Linux or Mac OS
+
+// Base of the links that are a file descriptor: waits with select() and reads with read().
+class FdTransport : public Transport
+{
+public:
+    FdTransport(int _mode, int _fd = -1) : Transport(_mode), fd(_fd) {}
+    virtual ~FdTransport();
+
+    virtual bool send(const uint8_t *data, int len);
+    virtual int recv(void *data, int len, int timeout_ms);
+    virtual int handle(void) const { return fd; }
+
+protected:
+    int fd;
+};
+
+// USB-UART device or Bluetooth virtual serial port ("/dev/..." or "/dev/...:<baud rate>"), see initSerial().
+// Each read waits for whole packets, as many as fit in VMIN and in the block being read.
+class SerialTransport : public FdTransport
+{
+public:
+    SerialTransport(const char *path, int baud);
+
+    virtual bool send(const uint8_t *data, int len);     //Not a socket, written with write()
+    virtual void setReadSize(int packet_size, int block_size);
+};
+
+// Device connecting to the host as a TCP client ("server_tcp:<port>").
+class TcpServerTransport : public FdTransport
+{
+public:
+    TcpServerTransport(char *port_str);
+};
+
+// Device sending datagrams to the host ("server_udp:<port>"). Commands go to the address of the first datagram.
+class UdpTransport : public FdTransport
+{
+public:
+    UdpTransport(char *port_str);
+
+    virtual bool send(const uint8_t *data, int len);
+    virtual void flush(int timeout_ms) {}   //Datagrams are never partial, nothing to resynchronize
+
+private:
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len;
+};
+
+// Device acting as a TCP server ("client_tcp:<host>:<port>").
+class TcpClientTransport : public FdTransport
+{
+public:
+    TcpClientTransport(const char *host, const char *port);
+
+    virtual bool reconnect(void);
+    virtual bool canReconnect(void) const { return true; }
+
+private:
+    std::string host;
+    std::string port;
+};
+
+#ifdef HASBLUETOOTH
+// Bluetooth RFCOMM socket to a device MAC address, or to the name of a device in the inventory.
+class RfcommTransport : public FdTransport
+{
+public:
+    RfcommTransport(const char *address);
+
+    virtual bool reconnect(void);
+    virtual bool canReconnect(void) const { return true; }
+
+private:
+    int connect(void);
+
+    std::string bt_address;
+};
+#endif // HASBLUETOOTH
+
+// In-process link: the host end of a socket pair whose other end, peer(), acts as the device.
+// A simulated device reads the commands (CMD_MAX_BYTES each) from peer() and writes its packets to it,
+// so tests and benchmarks run the whole protocol without hardware.
+class LoopbackTransport : public FdTransport
+{
+public:
+    LoopbackTransport(int _mode = COM_MODE_LOOPBACK);
+    virtual ~LoopbackTransport();
+
+    /// Device end of the link, owned by the transport.
+    int peer(void) const { return peer_fd; }
+
+private:
+    int peer_fd;
+};
+
+// Plays a capture back as a device through a loopback link ("replay:<file>[@<factor>|@max]"), see Replay.
+class ReplayTransport : public LoopbackTransport
+{
+public:
+    ReplayTransport(const char *file_name, double speed);
+    virtual ~ReplayTransport();
+
+private:
+    Replay *replay;
+};
+
+#endif // Linux or Mac OS
+
+#endif
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include "trigger.h"
+#include "scientisst.h"
+
+void TriggerSink::open(const Block &layout){
+    if(config.pre_s < 0 || config.post_s < 0 || !(config.edge & TRIGGER_BOTH))
+        throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+
+    ch = -1;
+    if(config.source != TRIGGER_I1 && config.source != TRIGGER_I2){
+        for(int i = 0; i < layout.num_chs; i++){
+            if(layout.chs[i] == config.source)   ch = i;
+        }
+        if(ch < 0)   throw ScientISST::Exception(ScientISST::Exception::INVALID_PARAMETER);
+    }
+
+    pre_frames = (int)(config.pre_s*layout.sample_rate + 0.5);
+    post_frames = std::max(1, (int)(config.post_s*layout.sample_rate + 0.5));
+
+    //An event hands over the ring and at most one block
+    ring.resize(layout.num_chs, pre_frames);
+    out.resize(layout.num_chs, pre_frames + layout.capacity);
+    for(int i = 0; i < layout.num_chs; i++)
+        ring.chs[i] = out.chs[i] = layout.chs[i];
+    ring.sample_rate = out.sample_rate = layout.sample_rate;
+
+    remaining = 0;
+    primed = false;
+    ring_head = ring_len = 0;
+    skipped = 0;
+    events = 0;
+
+    target->open(out);
+}
+
+/*****************************************************************************/
+
+// Returns true if frame n of b meets the condition. Called once for every frame, in order.
+bool TriggerSink::detect(const Block &b, int n){
+    int32_t value, level;
+    bool hit = false;
+
+    if(ch < 0){
+        value = (b.digital[n] >> (config.source == TRIGGER_I1 ? 3 : 2)) & 1;
+        level = 1;
+    }else{
+        value = b.mvCh(ch)[n];
+        level = config.threshold;
+    }
+
+    if(primed){
+        if((config.edge & TRIGGER_RISING) && last < level && value >= level)    hit = true;
+        if((config.edge & TRIGGER_FALLING) && last >= level && value < level)   hit = true;
+    }
+    last = value;
+    primed = true;
+
+    return hit;
+}
+
+/*****************************************************************************/
+
+// Adds frames to the ring, dropping the oldest ones.
+void TriggerSink::keep(const Block &b, int first, int count){
+    if(count > pre_frames){
+        skipped += count-pre_frames;
+        first += count-pre_frames;
+        count = pre_frames;
+    }
+    if(count <= 0)   return;
+
+    const int overflow = ring_len + count - pre_frames;
+    if(overflow > 0){
+        ring_head = (ring_head + overflow) % pre_frames;
+        ring_len -= overflow;
+        skipped += overflow;
+    }
+
+    int pos = (ring_head + ring_len) % pre_frames;
+    while(count > 0){
+        const int n = std::min(count, pre_frames-pos);
+        ring.copy(pos, b, first, n);
+        pos = (pos + n) % pre_frames;
+        first += n;
+        count -= n;
+        ring_len += n;
+    }
+}
+
+/*****************************************************************************/
+
+void TriggerSink::append(const Block &src, int first, int count){
+    out.copy(out.num_frames, src, first, count);
+    out.num_frames += std::max(count, 0);
+}
+
+/*****************************************************************************/
+
+// Moves the ring, oldest frame first, to out.
+void TriggerSink::flushRing(void){
+    const int n = std::min(ring_len, pre_frames-ring_head);
+
+    append(ring, ring_head, n);
+    append(ring, 0, ring_len-n);
+    ring_head = ring_len = 0;
+}
+
+/*****************************************************************************/
+
+void TriggerSink::emit(void){
+    if(out.num_frames == 0)   return;
+
+    if(skipped){
+        target->gap((int)(skipped*1000/out.sample_rate), (int)std::min(skipped, (uint64_t)INT32_MAX));
+        skipped = 0;
+    }
+    target->write(out);
+    out.num_frames = 0;
+}
+
+/*****************************************************************************/
+
+void TriggerSink::write(const Block &b){
+    int run = 0;    //First frame of b not yet kept or appended
+
+    for(int n = 0; n < b.num_frames; n++){
+        const bool hit = detect(b, n);
+
+        if(remaining == 0){
+            if(!hit)   continue;
+
+            //New event: the frames before it in the ring, then the recording from frame n on
+            keep(b, run, n-run);
+            flushRing();
+            run = n;
+            events++;
+        }
+
+        if(hit)   remaining = post_frames;
+        if(--remaining == 0){
+            append(b, run, n+1-run);
+            run = n+1;
+            emit();
+        }
+    }
+
+    if(remaining > 0){
+        append(b, run, b.num_frames-run);
+        emit();
+    }else{
+        keep(b, run, b.num_frames-run);
+    }
+}
+
+/*****************************************************************************/
+
+void TriggerSink::gap(int gap_ms, int missing_frames){
+    primed = false;     //No edge across the gap
+
+    if(remaining > 0){
+        target->gap(gap_ms, missing_frames);
+    }else{
+        //The ring no longer leads up to the next frames
+        skipped += ring_len + missing_frames;
+        ring_head = ring_len = 0;
+    }
+}
+
+/*****************************************************************************/
+
+void TriggerSink::close(void){
+    remaining = 0;
+    target->close();
+}
@@ -0,0 +1,69 @@
+#ifndef _TRIGGER_H
+#define _TRIGGER_H
+
+#include <cstdint>
+#include "block.h"
+#include "sink.h"
+
+#define TRIGGER_I1          9       //Digital input I1 as trigger source, AI1...AX2 (1...8) trigger on a threshold
+#define TRIGGER_I2          10      //Digital input I2 as trigger source
+
+#define TRIGGER_RISING      1
+#define TRIGGER_FALLING     2
+#define TRIGGER_BOTH        (TRIGGER_RISING | TRIGGER_FALLING)
+
+/// Condition and windows of a TriggerSink.
+struct TriggerConfig
+{
+    int source;             ///< TRIGGER_I1, TRIGGER_I2 or the channel (AI1...AX2) whose value crosses threshold
+    int edge;               ///< TRIGGER_RISING, TRIGGER_FALLING or TRIGGER_BOTH
+    int32_t threshold;      ///< Level of a channel source, in mV for AI channels, sign extended value for AX channels
+    float pre_s;            ///< Seconds kept before each trigger
+    float post_s;           ///< Seconds recorded from each trigger on, a trigger within them extends the recording
+
+    TriggerConfig(void) : source(TRIGGER_I1), edge(TRIGGER_RISING), threshold(0), pre_s(1), post_s(1) {}
+};
+
+// Hands another sink only the frames around events, so long monitoring sessions store little more than the events.
+// While waiting, the last pre_s seconds of frames are kept in a ring buffer allocated by open(). When the condition
+// is met, the ring and the next post_s seconds go to the target, each event starting with a new write(). Frames left
+// out are reported to the target as a gap() before the next frame it gets, so its file keeps the timeline.
+class TriggerSink : public Sink
+{
+public:
+    /// \param[in] _target Sink of the events, opened and closed with this one. It is not owned.
+    TriggerSink(Sink *_target, const TriggerConfig &_config) : events(0), target(_target), config(_config) {}
+
+    /** Allocates the ring buffer for the sample rate of layout and opens the target.
+        * \exception ScientISST::Exception (INVALID_PARAMETER) if the source channel is not acquired or a window is negative
+        */
+    virtual void open(const Block &layout);
+    virtual void write(const Block &b);
+    virtual void gap(int gap_ms, int missing_frames);
+    virtual void close(void);
+
+    uint64_t events;        ///< Events since open(), a trigger extending a recording doesn't count
+
+private:
+    bool detect(const Block &b, int n);
+    void keep(const Block &b, int first, int count);
+    void append(const Block &src, int first, int count);
+    void flushRing(void);
+    void emit(void);
+
+    Sink *target;
+    TriggerConfig config;
+    int ch;                     //Index of the source channel in the blocks, -1 for a digital input
+    int pre_frames;
+    int post_frames;
+    int remaining;              //Frames left in the recording, 0 while waiting
+    bool primed;                //last holds the source value of the previous frame
+    int32_t last;
+    Block ring;                 //Last frames while waiting, the oldest at ring_head
+    int ring_head;
+    int ring_len;
+    Block out;                  //Frames for the target, handed over at the end of an event or of write()
+    uint64_t skipped;           //Frames left out since the last one handed to the target
+};
+
+#endif
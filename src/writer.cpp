@@ -0,0 +1,413 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "writer.h"
+
+static int64_t nowMs(void){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*****************************************************************************/
+
+FileWriter::FileWriter(void){
+    rotating = false;
+    segment = 0;
+    segment_start_ms = 0;
+    fd = -1;
+    ckpt_fd = -1;
+    direct = false;
+    regular = false;
+    allocated = 0;
+    written = 0;
+    segment_bytes = 0;
+    current.data = NULL;
+    current.length = 0;
+    current.ends_segment = false;
+    closing = false;
+}
+
+/*****************************************************************************/
+
+bool FileWriter::open(const char *_file_name, const WriterConfig &_config){
+    close();
+
+    file_name = _file_name;
+    config = _config;
+    rotating = (config.rotate_bytes > 0 || config.rotate_s > 0);
+    closing = false;
+    segment_header.clear();
+
+    //Go on from the last segment of a previous recording with the same name
+    segment = 0;
+    if(rotating){
+        FILE *manifest = fopen((file_name + WRITER_MANIFEST_EXT).c_str(), "r");
+        if(manifest != NULL){
+            char line[1024];
+            while(fgets(line, sizeof(line), manifest) != NULL){
+                int n;
+                if(line[0] != '#' && sscanf(line, "%d", &n) == 1)
+                    segment = std::max(segment, n);
+            }
+            fclose(manifest);
+        }
+    }
+
+    if(!openSegment())   return false;
+
+    //One buffer being filled, the others free, and one more for the partial buffer written by checkpoints
+    for(int i = 0; i <= WRITER_BUFFERS; i++){
+        Buffer b;
+        if(posix_memalign((void**)&b.data, WRITER_ALIGNMENT, WRITER_BUFFER_SIZE) != 0){
+            perror("posix_memalign");
+            exit(EXIT_FAILURE);
+        }
+        b.length = 0;
+        b.ends_segment = false;
+        free_buffers.push_back(b);
+    }
+    current = free_buffers.back();
+    free_buffers.pop_back();
+    full.reserve(WRITER_BUFFERS+1);
+
+    segment_bytes = 0;
+    segment_opened = std::chrono::steady_clock::now();
+
+    thread = std::thread(&FileWriter::run, this);
+    return true;
+}
+
+/*****************************************************************************/
+
+void FileWriter::header(const void *data, size_t len){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    segment_header.assign((const uint8_t*)data, (const uint8_t*)data + len);
+    append(data, len);
+    segment_bytes += len;
+}
+
+/*****************************************************************************/
+
+void FileWriter::write(const void *data, size_t len){
+    std::unique_lock<std::mutex> lock(mutex);
+
+    //Segments end between writes, and hold at least one write after the header
+    if(rotating && segment_bytes > segment_header.size() &&
+       ((config.rotate_bytes > 0 && segment_bytes + len > config.rotate_bytes) ||
+        (config.rotate_s > 0 && std::chrono::steady_clock::now() - segment_opened >= std::chrono::seconds(config.rotate_s)))){
+        current.ends_segment = true;
+        full.push_back(current);
+        cv.notify_all();
+
+        cv.wait(lock, [this](){ return free_buffers.size() > 1; });
+        current = free_buffers.back();
+        free_buffers.pop_back();
+
+        segment_bytes = 0;
+        segment_opened = std::chrono::steady_clock::now();
+        append(&segment_header[0], segment_header.size());
+        segment_bytes += segment_header.size();
+    }
+
+    append(data, len);
+    segment_bytes += len;
+}
+
+/*****************************************************************************/
+
+// Copies data to the buffers, handing each one to the writer thread as it fills. Called with mutex held.
+void FileWriter::append(const void *data, size_t len){
+    const uint8_t *p = (const uint8_t*)data;
+    std::unique_lock<std::mutex> lock(mutex, std::adopt_lock);
+
+    while(len > 0){
+        const size_t n = std::min(len, (size_t)WRITER_BUFFER_SIZE-current.length);
+        memcpy(current.data+current.length, p, n);
+        current.length += n;
+        p += n;
+        len -= n;
+
+        if(current.length == WRITER_BUFFER_SIZE){
+            full.push_back(current);
+            cv.notify_all();
+
+            //Only the writer thread's spare buffer left, the disk is not keeping up
+            cv.wait(lock, [this](){ return free_buffers.size() > 1; });
+            current = free_buffers.back();
+            free_buffers.pop_back();
+        }
+    }
+
+    lock.release();
+}
+
+/*****************************************************************************/
+
+void FileWriter::close(void){
+    if(!thread.joinable())   return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    cv.notify_all();
+    thread.join();
+
+    free(current.data);
+    for(size_t i = 0; i < free_buffers.size(); i++)
+        free(free_buffers[i].data);
+    free_buffers.clear();
+    current.data = NULL;
+    current.length = 0;
+}
+
+/*****************************************************************************/
+
+bool FileWriter::recover(const char *file_name){
+    const std::string ckpt_name = std::string(file_name) + WRITER_CHECKPOINT_EXT;
+    char text[32] = {0};
+    unsigned long long length = 0;
+
+    int ckpt = ::open(ckpt_name.c_str(), O_RDONLY);
+    if(ckpt < 0)   return false;
+
+    if(::read(ckpt, text, sizeof(text)-1) > 0)
+        sscanf(text, "%llu", &length);
+    ::close(ckpt);
+
+    if(truncate(file_name, length) != 0){
+        perror("truncate");
+        return false;
+    }
+    unlink(ckpt_name.c_str());
+    return true;
+}
+
+/*****************************************************************************/
+
+void FileWriter::run(void){
+    std::chrono::steady_clock::time_point next_checkpoint = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.checkpoint_ms);
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(1){
+        if(config.checkpoint_ms > 0)
+            cv.wait_until(lock, next_checkpoint, [this](){ return closing || !full.empty(); });
+        else
+            cv.wait(lock, [this](){ return closing || !full.empty(); });
+
+        while(!full.empty()){
+            Buffer b = full.front();
+            full.erase(full.begin());
+
+            lock.unlock();
+            writeBuffer(b, written);
+            written += b.length;
+            if(b.ends_segment){
+                closeSegment(written);
+                openSegment();
+            }
+            lock.lock();
+
+            b.length = 0;
+            b.ends_segment = false;
+            free_buffers.push_back(b);
+            cv.notify_all();
+        }
+
+        if(closing){
+            writeBuffer(current, written);
+            const uint64_t length = written + current.length;
+            lock.unlock();
+
+            closeSegment(length);
+            return;
+        }
+
+        if(config.checkpoint_ms > 0 && ckpt_fd >= 0 && std::chrono::steady_clock::now() >= next_checkpoint){
+            //The partial buffer is written now and again once it is full
+            Buffer tail = free_buffers.back();
+            memcpy(tail.data, current.data, current.length);
+            tail.length = current.length;
+            free_buffers.pop_back();
+            lock.unlock();
+
+            writeBuffer(tail, written);
+            const uint64_t length = written + tail.length;
+#ifdef __APPLE__
+            fcntl(fd, F_FULLFSYNC);
+#else
+            fdatasync(fd);
+#endif
+            char text[32];
+            const int n = snprintf(text, sizeof(text), "%020llu\n", (unsigned long long)length);
+            if(pwrite(ckpt_fd, text, n, 0) != n)   perror("checkpoint");
+            fsync(ckpt_fd);
+
+            lock.lock();
+            tail.length = 0;
+            free_buffers.push_back(tail);
+            cv.notify_all();
+        }
+        if(config.checkpoint_ms > 0 && std::chrono::steady_clock::now() >= next_checkpoint){
+            next_checkpoint += std::chrono::milliseconds(config.checkpoint_ms);
+            if(next_checkpoint < std::chrono::steady_clock::now())    //The disk was too slow, don't try to catch up
+                next_checkpoint = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.checkpoint_ms);
+        }
+    }
+}
+
+/*****************************************************************************/
+
+// Opens the file, or the next segment, with its checkpoint file.
+bool FileWriter::openSegment(void){
+    segment_name = file_name;
+    if(rotating){
+        //A segment being written when a recording crashed is not in the manifest, its number is taken too
+        do{
+            segment_name = segmentName(++segment);
+        }while(access(segment_name.c_str(), F_OK) == 0 || access((segment_name + WRITER_CHECKPOINT_EXT).c_str(), F_OK) == 0);
+    }
+    segment_start_ms = nowMs();
+    allocated = 0;
+    written = 0;
+
+    direct = false;
+#ifdef O_DIRECT
+    fd = ::open(segment_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+    direct = (fd >= 0);
+    if(fd < 0 && errno == EINVAL)   //The file system does not support O_DIRECT
+#endif
+        fd = ::open(segment_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0){
+        perror(segment_name.c_str());
+        return false;
+    }
+
+    //Pipes and devices are written as they are, without preallocation, O_DIRECT or checkpoints
+    struct stat st;
+    regular = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+    if(!regular){
+#ifdef O_DIRECT
+        if(direct)   fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+        direct = false;
+        allocated = UINT64_MAX;
+    }
+
+    ckpt_fd = -1;
+    if(config.checkpoint_ms > 0 && regular){
+        ckpt_fd = ::open((segment_name + WRITER_CHECKPOINT_EXT).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if(ckpt_fd < 0){
+            perror(segment_name.c_str());
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*****************************************************************************/
+
+// Trims the file to length, syncs it and, when rotating, lists it in the manifest.
+void FileWriter::closeSegment(uint64_t length){
+    if(fd < 0)   return;
+
+    //Drop the padding of the last O_DIRECT write and the preallocated space
+    if(regular){
+        if(ftruncate(fd, length) != 0)   perror("ftruncate");
+        fsync(fd);
+    }
+    ::close(fd);
+    fd = -1;
+
+    if(ckpt_fd >= 0){
+        ::close(ckpt_fd);
+        ckpt_fd = -1;
+        unlink((segment_name + WRITER_CHECKPOINT_EXT).c_str());
+    }
+
+    if(rotating){
+        const std::string manifest_name = file_name + WRITER_MANIFEST_EXT;
+        FILE *manifest = fopen(manifest_name.c_str(), "a");
+        if(manifest == NULL){
+            perror(manifest_name.c_str());
+            return;
+        }
+        if(ftell(manifest) == 0)
+            fprintf(manifest, "# segment\tfile\tstart_ms\tend_ms\tbytes\n");
+
+        //Segments are named by their full path, the manifest only keeps the file name
+        const size_t slash = segment_name.rfind('/');
+        fprintf(manifest, "%06d\t%s\t%lld\t%lld\t%llu\n", segment, segment_name.c_str() + (slash == std::string::npos ? 0 : slash+1),
+                (long long)segment_start_ms, (long long)nowMs(), (unsigned long long)length);
+        fflush(manifest);
+        fsync(fileno(manifest));
+        fclose(manifest);
+    }
+}
+
+/*****************************************************************************/
+
+// "dir/name.ext" becomes "dir/name_000001.ext".
+std::string FileWriter::segmentName(int n) const{
+    char number[16];
+    const size_t slash = file_name.rfind('/');
+    size_t dot = file_name.rfind('.');
+
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == (slash == std::string::npos ? 0 : slash+1))
+        dot = file_name.size();
+
+    snprintf(number, sizeof(number), "_%06d", n);
+    return file_name.substr(0, dot) + number + file_name.substr(dot);
+}
+
+/*****************************************************************************/
+
+// Writes a buffer at offset at, extending the preallocated space first. O_DIRECT writes are padded to
+// WRITER_ALIGNMENT, the padding is overwritten by the next write or truncated by close().
+void FileWriter::writeBuffer(const Buffer &b, uint64_t at){
+    size_t size = b.length;
+
+    if(size == 0 || fd < 0)   return;
+
+    if(direct){
+        size = (size + WRITER_ALIGNMENT-1) / WRITER_ALIGNMENT * WRITER_ALIGNMENT;
+        memset(b.data+b.length, 0, size-b.length);
+    }
+
+    while(at + size > allocated){
+#ifdef __linux__
+        if(posix_fallocate(fd, allocated, WRITER_PREALLOC_SIZE) != 0){     //Not supported, let the writes extend the file
+            allocated = UINT64_MAX;
+            break;
+        }
+#endif
+        allocated += WRITER_PREALLOC_SIZE;
+    }
+
+    for(size_t done = 0; done < size;){
+        //Pipes and devices have no offset, pwrite() would fail with ESPIPE
+        ssize_t ret = regular ? pwrite(fd, b.data+done, size-done, at+done) : ::write(fd, b.data+done, size-done);
+        if(ret < 0){
+            if(errno == EINTR)   continue;
+#ifdef O_DIRECT
+            if(errno == EINVAL && direct){     //O_DIRECT refused by the file system after all
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                direct = false;
+                size = b.length;
+                continue;
+            }
+#endif
+            perror("FileWriter write");
+            return;
+        }
+        done += ret;
+    }
+}
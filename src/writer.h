@@ -0,0 +1,113 @@
+#ifndef _WRITER_H
+#define _WRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define WRITER_BUFFER_SIZE      (1024*1024)         //Bytes written to the file at once, a multiple of WRITER_ALIGNMENT
+#define WRITER_BUFFERS          8                   //Buffers in flight before write() waits for the disk
+#define WRITER_ALIGNMENT        4096                //Alignment of the buffers, offsets and sizes of O_DIRECT writes
+#define WRITER_PREALLOC_SIZE    (64*1024*1024)      //The file is extended in steps of this size
+#define WRITER_CHECKPOINT_MS    1000                //Default interval between checkpoints
+#define WRITER_CHECKPOINT_EXT   ".ckpt"             //Suffix of the checkpoint file
+#define WRITER_MANIFEST_EXT     ".manifest"         //Suffix of the segment list of a rotated recording
+
+/// Options of a FileWriter, and of the sinks writing through one.
+struct WriterConfig
+{
+    int checkpoint_ms;          ///< Interval between checkpoints, 0 disables them
+    uint64_t rotate_bytes;      ///< Start a new segment once a segment reaches this size, 0 for no limit
+    int rotate_s;               ///< Start a new segment once a segment spans this many seconds, 0 for no limit
+
+    WriterConfig(void) : checkpoint_ms(WRITER_CHECKPOINT_MS), rotate_bytes(0), rotate_s(0) {}
+};
+
+// Appends to a file from a background thread, so the acquisition never waits for the disk unless it falls
+// WRITER_BUFFERS buffers behind. The file is preallocated, written in large aligned blocks bypassing the
+// page cache where O_DIRECT is supported, and checkpointed at a fixed interval: the data written so far is
+// synced, then its length is synced to "<file>.ckpt". close() truncates the file to its length and removes
+// the checkpoint file; after a crash recover() truncates the file to the last checkpoint instead.
+//
+// With rotation the recording is split in segments "<name>_000001<ext>", "<name>_000002<ext>", ... each one
+// starting with the header given to header(). A segment only ends between two write() calls, so records are
+// never split. Closed segments are listed in "<file_name>.manifest", and the numbering goes on from the last
+// segment of an existing manifest, skipping the numbers of existing segment or checkpoint files, such as the
+// segment of a crashed recording, so they are never truncated.
+class FileWriter
+{
+public:
+    FileWriter(void);
+    ~FileWriter() { close(); }
+
+    /** Creates or truncates the file, or the first segment, and starts the writer thread.
+        * \return false if the file cannot be created
+        */
+    bool open(const char *file_name, const WriterConfig &config = WriterConfig());
+
+    /// Sets the bytes written at the start of each segment and writes them now. Call it once, right after open().
+    void header(const void *data, size_t len);
+
+    /// Appends len bytes. Returns at once unless the writer thread is WRITER_BUFFERS buffers behind.
+    void write(const void *data, size_t len);
+
+    /// Writes everything, syncs the file and stops the writer thread.
+    void close(void);
+
+    bool isOpen(void) const { return thread.joinable(); }
+
+    /** Truncates a file left by a crashed recording to its last checkpoint and removes the checkpoint file.
+        * \param[in] file_name The file, or the segment, that was being written
+        * \return false if the file has no checkpoint file
+        */
+    static bool recover(const char *file_name);
+
+private:
+    struct Buffer
+    {
+        uint8_t *data;
+        size_t length;
+        bool ends_segment;          //The next buffer goes to a new segment
+    };
+
+    void run(void);
+    void writeBuffer(const Buffer &b, uint64_t at);
+    bool openSegment(void);
+    void closeSegment(uint64_t length);
+    void append(const void *data, size_t len);
+    std::string segmentName(int n) const;
+
+    std::string file_name;
+    WriterConfig config;
+    bool rotating;
+
+    //Used by the writer thread once it is started
+    std::string segment_name;
+    int segment;                    //Number of the segment being written, 0 without rotation
+    int64_t segment_start_ms;       //Host time the segment was opened, in ms since the epoch
+    int fd;
+    int ckpt_fd;
+    bool direct;                    //fd was opened with O_DIRECT
+    bool regular;                   //fd is a regular file, not a pipe or a device
+    uint64_t allocated;             //Bytes preallocated
+    uint64_t written;               //Bytes of whole buffers written to the segment
+
+    //Used by write()
+    std::vector<uint8_t> segment_header;
+    uint64_t segment_bytes;         //Bytes given to the current segment
+    std::chrono::steady_clock::time_point segment_opened;
+
+    std::mutex mutex;               //Guards the members below
+    std::condition_variable cv;     //Signals a full buffer, a free buffer or closing
+    Buffer current;                 //Buffer being filled by write()
+    std::vector<Buffer> full;       //Oldest first, reserved for all the buffers so that write() never allocates
+    std::vector<Buffer> free_buffers;
+    bool closing;
+    std::thread thread;
+};
+
+#endif
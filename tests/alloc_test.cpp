@@ -0,0 +1,123 @@
+// Checks that ScientISST::read() doesn't allocate once an acquisition is running, with the default block
+// size and with 10 ms blocks. A simulated device answers the commands and streams AI1 packets through a
+// LoopbackTransport. Exits with 1 if any allocation is made during read().
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <new>
+#include <thread>
+#include "scientisst.h"
+#include "packet.h"
+
+#define TEST_READS      300     //read() calls checked in each configuration
+#define TEST_WARMUP     20      //read() calls before counting, while the block size settles
+#define TEST_BURST      1000    //Packets the device writes at a time
+
+static std::atomic<long> allocations(0);
+static thread_local bool counting = false;
+
+void* operator new(size_t n){
+    if(counting)   allocations++;
+    void *p = malloc(n ? n : 1);
+    if(p == NULL)   throw std::bad_alloc();
+    return p;
+}
+// Not inlined, so the compiler doesn't pair the free() with a new it can't see was replaced
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept { free(p); }
+
+/*****************************************************************************/
+
+// AI1 packet of the binary API: 12-bit value, 4-bit sequence number and CRC.
+static void makePacket(unsigned char *p, int value, int seq){
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0x0F;
+    for(int crc = 0; crc < 16; crc++){
+        p[2] = (seq << 4) | crc;
+        if(checkCRC4(p, 3))   return;
+    }
+}
+
+/*****************************************************************************/
+
+// Answers the version command and streams packets while in live mode, until stop is set.
+static void simulateDevice(int fd, const std::atomic<bool> &stop){
+    unsigned char cmd[CMD_MAX_BYTES], burst[3*TEST_BURST];
+    int received = 0, k = 0;
+    bool live = false;
+
+    while(!stop){
+        struct pollfd p = {fd, POLLIN, 0};
+        if(poll(&p, 1, live ? 0 : 50) > 0){
+            const int ret = read(fd, cmd+received, CMD_MAX_BYTES-received);
+            if(ret <= 0)   return;
+            received += ret;
+            if(received < CMD_MAX_BYTES)   continue;
+            received = 0;
+
+            if(cmd[0] == 0x07){     //Version string, with its '\0', and adc characteristics
+                const char version[] = "alloc-test";
+                const uint32_t adc_chars[6] = {0, 3, 1, 1, 100, 1100};
+                unsigned char reply[sizeof(version) + sizeof(adc_chars)];
+                memcpy(reply, version, sizeof(version));
+                memcpy(reply+sizeof(version), adc_chars, sizeof(adc_chars));
+                if(write(fd, reply, sizeof(reply)) < 0)   return;
+            }else if(cmd[0] == 0x01 || cmd[0] == 0x02){
+                live = true;
+            }else if(cmd[0] == 0x00){
+                live = false;
+            }
+        }else if(live){
+            for(int i = 0; i < TEST_BURST; i++, k++)
+                makePacket(burst + 3*i, k & 0xFFF, k & 0x0F);
+            if(write(fd, burst, sizeof(burst)) < 0)   return;
+        }
+    }
+}
+
+/*****************************************************************************/
+
+static long countAllocations(ScientISST &dev, int block_ms){
+    dev.blockDuration(block_ms);
+    dev.start(1000, {AI1}, "/dev/null");
+
+    for(int i = 0; i < TEST_WARMUP; i++)
+        dev.read();
+
+    allocations = 0;
+    counting = true;
+    for(int i = 0; i < TEST_READS; i++)
+        dev.read();
+    counting = false;
+
+    dev.stop();
+    return allocations;
+}
+
+/*****************************************************************************/
+
+int main(){
+    LoopbackTransport *link = new LoopbackTransport();
+    std::atomic<bool> stop(false);
+    std::thread device(simulateDevice, link->peer(), std::cref(stop));
+    int failed = 0;
+
+    {
+        ScientISST dev(link);
+        const int block_ms[] = {0, 10};
+
+        for(int i = 0; i < 2; i++){
+            const long n = countAllocations(dev, block_ms[i]);
+            printf("%s blocks: %ld allocations in %d read() calls\n", block_ms[i] ? "10 ms" : "default", n, TEST_READS);
+            if(n != 0)   failed = 1;
+        }
+        stop = true;
+    }
+    device.join();
+
+    puts(failed ? "FAILED" : "OK");
+    return failed;
+}